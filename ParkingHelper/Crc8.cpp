@@ -0,0 +1,21 @@
+/*
+* Crc8.cpp
+*
+* Created: 10/17/2026 4:18:22 PM
+*/
+
+#include "Crc8.h"
+
+uint8_t crc8(const uint8_t* data, uint8_t length)
+{
+	uint8_t crc = 0xFF;
+	while (length--)
+	{
+		crc ^= *data++;
+		for (uint8_t bit = 0; bit < 8; ++bit)
+		{
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+	}
+	return crc;
+}
@@ -0,0 +1,17 @@
+/*
+* Crc8.h
+*
+* Created: 10/17/2026 4:18:22 PM
+*/
+
+
+#ifndef __CRC8_H__
+#define __CRC8_H__
+
+#include <stdint.h>
+
+// CRC-8 with polynomial x^8 + x^2 + x + 1, from 0xFF, so that neither erased nor zeroed EEPROM has a valid CRC. Kept
+// apart from the HAL so that host tools reading an EEPROM image check records with the firmware's own code.
+uint8_t crc8(const uint8_t* data, uint8_t length);
+
+#endif //__CRC8_H__
@@ -6,33 +6,72 @@
 */
 
 #include "DistanceSensor.h"
+#include "Instrumentation.h"
 #include <stdlib.h>
 #include <string.h>
-#include <avr/io.h>
-#include <util/delay.h>
-#include <avr/interrupt.h>
-#include <util/atomic.h>
 
-const uint8_t USECS_PER_TICK = 10;
-const uint32_t TIMEOUT_CYCLES = F_CPU / 1000 * 50 / 4;
-const uint8_t RECOVERY_TICKS = 80;
-const uint8_t TIMEOUT_TICKS = 50;
+// Per-unit calibration of the temperature sensor, in ADC counts (about 1C each), added to its readings (see
+// DistanceSensor.h)
+#if !defined(TEMPERATURE_SENSOR_OFFSET)
+#define TEMPERATURE_SENSOR_OFFSET 0
+#endif
 
-volatile static uint16_t g_echoTicks = 0;
-static uint8_t g_pinMask;
+// The recovery period after a timeout. After an echo, it is RECOVERY_FLOOR_TICKS plus RECOVERY_ECHO_MULTIPLE times the
+// echo: long enough for anything within the sensor's range to stop echoing the burst, and for multiple reflections
+// between a close vehicle and the sensor to die down. That is about 24ms at 20cm and 75ms at the 3m limit.
+const uint32_t RECOVERY_TICKS = MSECS_TO_SCHEDULER_TICKS(80);
+const uint32_t RECOVERY_FLOOR_TICKS = MSECS_TO_SCHEDULER_TICKS(20);
+const uint8_t RECOVERY_ECHO_MULTIPLE = 3;
+const uint16_t ECHO_TICKS_PER_SCHEDULER_TICK = SCHEDULER_TIMER_PRESCALER / ECHO_TIMER_PRESCALER;
+// The range gate is at least two Timer0 periods past the rising edge of the echo, so its window is always still to come.
+// Its compare value is kept clear of the start of the period, so the overflow handler can enable the compare before it
+// matches.
+const uint16_t MIN_GATE_TICKS = 512;
+const uint16_t MAX_ECHO_TICKS = ECHO_TICKS_PER_SEC * 37 / 2000;	// 18.5ms, beyond which there is nothing to gate
+const uint8_t MIN_GATE_COMPARE = 0x10;
+const uint32_t TIMEOUT_TICKS = MSECS_TO_SCHEDULER_TICKS(30);	// The longest echo the sensor reports is 18.5ms, 750uS after the trigger
+const uint32_t TEMPERATURE_INTERVAL = MSECS_TO_SCHEDULER_TICKS(180000);
+const uint8_t SPEED_SCALE_SHIFT = 15;
+
+// Speed of sound relative to SPEED_OF_SOUND_CM_PER_SEC (1.15 fixed point), for every other temperature sensor reading
+// from 230 (-40C) to 370 (85C), with the sensor's typical response: 230 at -40C, 300 at 25C and 370 at 85C, linear in
+// between. The speed is 331.3m/s * sqrt(1 + T / 273.15).
+const uint16_t TEMPERATURE_TABLE_FIRST_READING = 230;
+const uint8_t TEMPERATURE_TABLE_LENGTH = 71;
+const uint16_t speedScaleTable[TEMPERATURE_TABLE_LENGTH] PROGMEM = {
+	29474, 29591, 29708, 29824, 29940, 30055, 30170, 30285, 30399, 30512, 30625, 30738,
+	30851, 30962, 31074, 31185, 31296, 31406, 31516, 31626, 31735, 31844, 31952, 32060,
+	32168, 32276, 32383, 32489, 32596, 32702, 32807, 32912, 33017, 33122, 33226, 33330,
+	33426, 33521, 33617, 33711, 33806, 33900, 33994, 34088, 34182, 34275, 34368, 34461,
+	34553, 34646, 34738, 34830, 34921, 35013, 35104, 35195, 35285, 35376, 35466, 35556,
+	35645, 35735, 35824, 35913, 36002, 36091, 36179, 36267, 36355, 36443, 36530
+};
+
+volatile static uint8_t g_echoTimerHigh = 0;	// Upper byte of the echo timestamp, extended from Timer0 overflows
+volatile static uint16_t g_echoStart = 0;		// Timestamp of the rising edge of the echo pulse
+volatile static uint16_t g_echoTicks = 0;		// Echo pulse width, valid once the falling edge has been seen
+volatile static bool g_echoStarted = false;
+volatile static bool g_echoComplete = false;
+volatile static uint16_t g_gateTicks = 0;		// The reading sensor's gateTicks
+volatile static uint8_t g_gateWindow = 0;		// Timer0 period the range gate falls in, or zero if not armed
+static void (*volatile g_echoCompleteHandler)() = 0;
+volatile static uint8_t g_pinMask = 0;			// Echo pin of the sensor reading
 
 // default constructor
-DistanceSensor::DistanceSensor(uint8_t pin)
-	: m_capture(0), m_hasCapture(false), m_state(IDLE), m_ticksSinceStateChange(0)
+DistanceSensor::DistanceSensor(Sensor* sensors, uint8_t maxSensors, Scheduler* scheduler)
+	: m_sensors(sensors), m_maxSensors(maxSensors), m_numSensors(0), m_current(0), m_requests(0), m_state(IDLE),
+	m_scheduler(scheduler), m_speedScale(1 << SPEED_SCALE_SHIFT), m_temperatureTime(0), m_temperatureDue(true),
+	m_temperatureStep(TEMPERATURE_IDLE)
 {	
-	g_pinMask = _BV(pin);
+	m_timer = m_scheduler->addTimer(timerElapsed, this);
 
 	g_echoTicks = 0;
 	
-	// Configure Timer0 for 10 us interrupts
-	TCCR0A |= _BV(WGM01);	// CTC timer mode
-	TCCR0B |= _BV(CS00);	// Pre-scaler -> CPU clock / 1
-	OCR0A = (F_CPU / 1000000UL) * USECS_PER_TICK - 1;	// 10us interrupts
+	// Timer0 runs in normal mode as a free-running timestamp counter. It is only clocked while a capture is underway.
+	Timer0::controlA() = 0;
+	Timer0::controlB() = 0;
+	
+	PinChangeInterrupts::control() |= _BV(PCIE);	// Enable pin change interrupts. Only the pins set in PCMSK will trigger one.
 } //DistanceSensor
 
 // default destructor
@@ -40,20 +79,64 @@ DistanceSensor::~DistanceSensor()
 {
 } //~DistanceSensor
 
-float DistanceSensor::getCapture()
+uint8_t DistanceSensor::addSensor(uint8_t pin)
+{
+	if (m_numSensors == m_maxSensors)
+	{
+		return NO_SENSOR;
+	}
+	Sensor& sensor = m_sensors[m_numSensors];
+	sensor.pinMask = _BV(pin);
+	sensor.capture = 0;
+	sensor.filteredCapture = 0;
+	sensor.maxRange = 0;
+	sensor.gateTicks = 0;
+	sensor.captureTime = 0;
+	sensor.hasCapture = false;
+	sensor.filterEnabled = false;
+	return m_numSensors++;
+}
+
+uint16_t DistanceSensor::getCapture(uint8_t sensor)
+{
+	return m_sensors[sensor].filteredCapture;
+}
+
+uint16_t DistanceSensor::getCaptureAndClear(uint8_t sensor)
+{
+	m_sensors[sensor].hasCapture = false;
+	return m_sensors[sensor].filteredCapture;
+}
+
+uint16_t DistanceSensor::getRawCapture(uint8_t sensor)
 {
-	return captureTimeToCm(m_capture);
+	return m_sensors[sensor].capture;
 }
 
-float DistanceSensor::getCaptureAndClear()
+uint32_t DistanceSensor::getCaptureTime(uint8_t sensor)
 {
-	m_hasCapture = false;
-	return captureTimeToCm(m_capture);
+	return m_sensors[sensor].captureTime;
 }
 
-bool DistanceSensor::hasCapture()
+uint8_t DistanceSensor::lastSensor()
 {
-	return m_hasCapture;
+	return m_current;
+}
+
+void DistanceSensor::setEchoCompleteHandler(void (*handler)())
+{
+	g_echoCompleteHandler = handler;
+}
+
+void DistanceSensor::setFilterEnabled(bool enabled, uint8_t sensor)
+{
+	m_sensors[sensor].filterEnabled = enabled;
+	m_sensors[sensor].filter.reset();
+}
+
+bool DistanceSensor::hasCapture(uint8_t sensor)
+{
+	return m_sensors[sensor].hasCapture;
 }
 
 bool DistanceSensor::isReadyForCapture()
@@ -61,117 +144,346 @@ bool DistanceSensor::isReadyForCapture()
 	return m_state == IDLE;
 }
 
-float DistanceSensor::captureTimeToCm(float echoTicks)
+bool DistanceSensor::isCapturing()
 {
-	return (float)echoTicks * (float)USECS_PER_TICK * (34029.0f / 2.0f / 1000000.0f);
+	return m_state == CAPTURING;
+}
+
+void DistanceSensor::endRecovery()
+{
+	m_requests = 0;
+	if (m_state == RECOVERING)
+	{
+		if (m_temperatureStep == TEMPERATURE_CONVERTING)
+		{
+			finishTemperature();	// Rather than leave the ADC on
+		}
+		m_scheduler->cancel(m_timer);
+		m_state = IDLE;
+	}
 }
 
-void DistanceSensor::startCapture()
+void DistanceSensor::startCapture(uint8_t sensor)
 {
-	if (m_state != IDLE)
+	if (m_state == CAPTURING && sensor == m_current)
 	{
 		return;
 	}
+	m_requests |= _BV(sensor);
+	if (m_state == IDLE)
+	{
+		triggerNext();
+	}
+}
+
+// Starts a reading on the next sensor with one requested, after the one that read last
+void DistanceSensor::triggerNext()
+{
+	uint8_t sensor = m_current;
+	for (uint8_t i = 0; i < m_numSensors; ++i)
+	{
+		if (++sensor == m_numSensors)
+		{
+			sensor = 0;
+		}
+		if (m_requests & _BV(sensor))
+		{
+			trigger(sensor);
+			return;
+		}
+	}
+}
+
+void DistanceSensor::setMaxRange(uint16_t range, uint8_t sensor)
+{
+	m_sensors[sensor].maxRange = range;
+	m_sensors[sensor].filter.reset();
+	updateGate(m_sensors[sensor]);
+}
+
+// Converts the maximum range to echo ticks at the current temperature, for the interrupt handlers to compare against.
+// Only needed when the range or the temperature changes.
+void DistanceSensor::updateGate(Sensor& sensor)
+{
+	uint16_t gate = 0;
+	if (sensor.maxRange)
+	{
+		uint32_t ticks = ((uint32_t)sensor.maxRange << SPEED_SCALE_SHIFT) / m_speedScale;
+		gate = ticks < MIN_GATE_TICKS ? MIN_GATE_TICKS : ticks >= MAX_ECHO_TICKS ? 0 : (uint16_t)ticks;
+	}
+	sensor.gateTicks = gate;	// Taken up by the interrupt handlers at the sensor's next trigger
+}
+
+void DistanceSensor::remeasureTemperature()
+{
+	m_temperatureDue = true;
+}
+
+// The internal temperature sensor is read in the gaps of a reading, so the ADC is normally finished by the time it is
+// looked at (each conversion takes 100-200uS at 125kHz). The first conversion after selecting the 1.1V reference is
+// discarded; it runs from the trigger until the echo ends, at least 750uS later. The second runs from then until the
+// recovery period ends. The ADC is off the rest of the time, as it draws current whenever it is enabled.
+void DistanceSensor::startTemperature()
+{
+	Adc::multiplexer() = _BV(REFS1) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1) | _BV(MUX0);	// 1.1V reference, temperature sensor
+	Adc::control() = _BV(ADEN) | _BV(ADSC) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);	// Pre-scaler -> CPU clock / 128
+	m_temperatureStep = TEMPERATURE_SETTLING;
+}
+
+// Doesn't spin in practice: the first conversion takes 200uS, and no echo ends within the sensor's 750uS hold-off
+void DistanceSensor::convertTemperature()
+{
+	while (Adc::control() & _BV(ADSC))
+	{
+	}
+	Adc::control() |= _BV(ADSC);
+	m_temperatureStep = TEMPERATURE_CONVERTING;
+}
+
+// Looks up the speed of sound for the temperature just converted. Called at the end of the recovery period, at least
+// 20ms after the conversion started, unless endRecovery() cuts the period short; then it can spin for the rest of the
+// conversion, up to about 100uS.
+void DistanceSensor::finishTemperature()
+{
+	while (Adc::control() & _BV(ADSC))
+	{
+	}
+	uint16_t reading = Adc::result();
+	Adc::control() = 0;
+	m_temperatureStep = TEMPERATURE_IDLE;
+	
+	int16_t index = ((int16_t)reading + TEMPERATURE_SENSOR_OFFSET - (TEMPERATURE_TABLE_FIRST_READING - 1)) >> 1;	// Nearest entry
+	if (index < 0)
+	{
+		index = 0;
+	}
+	else if (index >= TEMPERATURE_TABLE_LENGTH)
+	{
+		index = TEMPERATURE_TABLE_LENGTH - 1;
+	}
+	m_speedScale = Flash::readWord(&speedScaleTable[index]);
+	m_temperatureTime = Scheduler::now();
+	m_temperatureDue = false;
+	for (uint8_t i = 0; i < m_numSensors; ++i)
+	{
+		updateGate(m_sensors[i]);
+	}
+}
 
+void DistanceSensor::trigger(uint8_t sensor)
+{
+	if (m_temperatureStep == TEMPERATURE_IDLE && (m_temperatureDue || Scheduler::now() - m_temperatureTime >= TEMPERATURE_INTERVAL))
+	{
+		startTemperature();
+	}
+	
 	m_state = CAPTURING;
-	m_hasCapture = false;
-	m_ticksSinceStateChange = 0;
+	m_current = sensor;
+	m_requests &= ~_BV(sensor);
+	m_sensors[sensor].hasCapture = false;
+	m_scheduler->startOneShot(m_timer, TIMEOUT_TICKS);
 	
-	// Trigger distance reading
-	DDRB |= (1 << DDB1);	// Set as output
-	PORTB |= (1 << PB1);	// Set HIGH
-	_delay_us(3);
-	PORTB &= ~(1 << PB1);	// Set LOW
-	DDRB &= ~(1 << DDB1);	// Set as input
-	_delay_us(50);			// Allow trigger line to stabilize
+	// Trigger distance reading. The pin isn't a constant, so the writes are read-modify-write; keep interrupt handlers
+	// that drive other PORTB pins from landing in between.
+	uint8_t pinMask = m_sensors[sensor].pinMask;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		PortB::ddr() |= pinMask;		// Set as output
+		PortB::port() |= pinMask;		// Set HIGH
+		Delay::us<3>();
+		PortB::port() &= ~pinMask;		// Set LOW
+		PortB::ddr() &= ~pinMask;		// Set as input
+	}
+	Delay::us<50>();				// Allow trigger line to stabilize
 	
+	g_pinMask = pinMask;
+	g_gateTicks = m_sensors[sensor].gateTicks;
 	g_echoTicks = 0;
+	g_echoStarted = false;
+	g_echoComplete = false;
 	enableInterrupt();
 }
 
 void DistanceSensor::enableInterrupt()
 {
-	TCNT0 = 0;				// Reset counter
-	TIFR |= _BV(OCF0A);		// Enable interrupt 
-	TIMSK |= _BV(OCIE0A);	// Enable output compare match interrupt	
+	if (!Instrumentation::ENABLED)
+	{
+		Timer0::counter() = 0;					// Reset counter, unless the UART is counting bit times on it
+	}
+	g_echoTimerHigh = 0;
+	g_gateWindow = 0;
+	Instrumentation::takeTimer0Overflow();		// Before it is discarded, if it is counting them
+	TimerInterrupts::flags() = _BV(TOV0);		// Clear any stale overflow flag (flags are cleared by writing a one)
+	TimerInterrupts::mask() |= _BV(TOIE0);		// Enable overflow interrupt, which extends the timestamp to 16 bits
+	Timer0::controlB() = _BV(CS01) | _BV(CS00);	// Pre-scaler -> CPU clock / 64
+	
+	PinChangeInterrupts::flags() = _BV(PCIF);	// Discard any pin change left over from the trigger pulse
+	PinChangeInterrupts::mask() |= g_pinMask;	// Enable pin change interrupt on the echo pin
 }
 
 void DistanceSensor::disableInterrupt()
 {
-	TIMSK &= ~(_BV(OCIE0A)); // Disable output compare match interrupt
+	PinChangeInterrupts::mask() &= ~g_pinMask;	// Disable pin change interrupt on the echo pin
+	TimerInterrupts::mask() &= ~(_BV(TOIE0) | _BV(OCIE0A));	// Disable overflow and range gate interrupts
+	if (!Instrumentation::ENABLED)
+	{
+		Timer0::controlB() = 0;					// Stop the timestamp clock, unless it is also the UART's bit clock
+	}
 }
 
-void DistanceSensor::tick()
+// The echo is complete once the interrupt handler has seen its falling edge. Until then, either the pulse is still
+// underway or the sensor hasn't started the reading yet (or something is wrong like the sensor isn't connected)
+static bool readEcho(uint16_t& duration)
 {
-	// TODO: replace ugly C-style switch statement with State pattern
-	switch (m_state)
+	bool complete;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 	{
-	case CAPTURING:
-		checkForCompleteCapture();
-		
-	case RECOVERING:
-		checkForCompleteRecovery();	
-		break;
-		
-	case IDLE:
-		break;
+		complete = g_echoComplete;
+		if (complete)
+		{
+			duration = g_echoTicks;
+		}
 	}
+	return complete;
 }
 
-bool DistanceSensor::checkForCompleteCapture()
+bool DistanceSensor::completeCapture()
 {
-	++m_ticksSinceStateChange;
-	
-	if (PINB & g_pinMask)
+	uint16_t duration;
+	if (m_state != CAPTURING || !readEcho(duration))
 	{
-		// Pin is still high, which means a capture is still underway
 		return false;
 	}
-	
-	// Pin value is low. This either means a capture completed or the sensor hasn't started the reading yet 
-	// (or something is wrong like the sensor isn't connected)
-	uint16_t duration;
-	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	processCapture(duration);
+	return true;
+}
+
+void DistanceSensor::processCapture(uint16_t duration)
+{
+	disableInterrupt();
+	Instrumentation::count(Instrumentation::CAPTURES);
+	Sensor& sensor = m_sensors[m_current];
+	uint16_t echo = duration == BEYOND_RANGE ? sensor.gateTicks : duration;	// The rest of a gated echo is within the floor
+	uint32_t recovery = echo ? RECOVERY_FLOOR_TICKS + (uint32_t)echo * RECOVERY_ECHO_MULTIPLE / ECHO_TICKS_PER_SCHEDULER_TICK : RECOVERY_TICKS;
+	if (duration != BEYOND_RANGE)
 	{
-		duration = g_echoTicks;
+		duration = ((uint32_t)duration * m_speedScale) >> SPEED_SCALE_SHIFT;	// To what it would have been at 15C
+		if (sensor.maxRange && duration >= sensor.maxRange)
+		{
+			duration = BEYOND_RANGE;	// Just short of the gate at the last temperature, or ended before it was enabled
+		}
 	}
-	
-	if (!duration && m_ticksSinceStateChange < TIMEOUT_TICKS)
+	sensor.capture = duration;
+	sensor.filteredCapture = sensor.filterEnabled ? sensor.filter.add(duration) : duration;
+	sensor.hasCapture = true;
+	sensor.captureTime = Scheduler::now();
+	if (m_temperatureStep == TEMPERATURE_SETTLING)
 	{
-		// No reading yet
-		return false;
+		convertTemperature();
 	}
 	
-	// We have a capture
-	m_capture = duration;
-	m_hasCapture = true;
-	
 	g_echoTicks = 0;
-	m_ticksSinceStateChange = 0;
 	m_state = RECOVERING;
-	
-	return true;
+	m_scheduler->startOneShot(m_timer, recovery);
 }
 
-void DistanceSensor::checkForCompleteRecovery()
+// Called when the capture times out, or when the recovery period after a capture ends
+void DistanceSensor::timerElapsed(void* context)
 {
-	++m_ticksSinceStateChange;
-	if ( m_ticksSinceStateChange > RECOVERY_TICKS)
+	DistanceSensor* sensor = (DistanceSensor*)context;
+	if (sensor->m_state == CAPTURING)
 	{
-		m_ticksSinceStateChange = 0;
-		m_state = IDLE;
+		uint16_t duration = 0;
+		if (!readEcho(duration))		// The echo may have ended just now, before its event was handled
+		{
+			Instrumentation::count(Instrumentation::TIMEOUTS);
+		}
+		sensor->processCapture(duration);	// Otherwise a timeout, reported as zero
+	}
+	else if (sensor->m_state == RECOVERING)
+	{
+		if (sensor->m_temperatureStep == TEMPERATURE_CONVERTING)
+		{
+			sensor->finishTemperature();
+		}
+		sensor->m_state = IDLE;
+		sensor->triggerNext();
+	}
+}
+
+// Returns the current echo timestamp. Must be called with interrupts disabled. If Timer0 has overflowed but the overflow
+// handler has not run yet, the low byte has wrapped and the high byte is one behind, so we account for that here.
+static inline uint16_t echoTimestamp()
+{
+	uint8_t low = Timer0::counter();
+	uint8_t high = g_echoTimerHigh;
+	if ((TimerInterrupts::flags() & _BV(TOV0)) && low < 0x80)
+	{
+		++high;
+	}
+	return ((uint16_t)high << 8) | low;
+}
+
+// This interrupt handler is called on TIMER0 overflow, every 256 timer ticks (1.024ms at 16MHz), while a capture is underway.
+// It extends the 8-bit timer to a 16-bit timestamp, and enables the range gate once its period has started.
+ISR(TIMER0_OVF_vect)
+{
+	Instrumentation::countTimer0Overflow();
+	uint8_t high = g_echoTimerHigh + 1;
+	g_echoTimerHigh = high;
+	if (high == g_gateWindow)
+	{
+		TimerInterrupts::flags() = _BV(OCF0A);	// Discard matches from earlier periods
+		TimerInterrupts::mask() |= _BV(OCIE0A);
 	}
 }
 
-// This interrupt handler is called on TIMER0 compare. TIMER0 is configured to run at approximately 10us intervals.
-// The interrupt handler does nothing but increment a 16-bit counter when PB1 is high. The logic to reset the counter,
-// send the start pulse, etc. is handled in the main loop. This allows us to keep the interrupt handler very short,
-// which in turn allows us to complete the ISR within the 2uS interval (about 16 clock cycles, minus overhead).
+// This interrupt handler is called when the echo passes the maximum range. It completes the reading as BEYOND_RANGE;
+// the falling edge, whenever it comes, is ignored.
 ISR(TIMER0_COMPA_vect)
 {
-	if (PINB & g_pinMask)
+	TimerInterrupts::mask() &= ~_BV(OCIE0A);
+	if (g_echoStarted && !g_echoComplete)
 	{
-		++g_echoTicks;
+		g_echoTicks = DistanceSensor::BEYOND_RANGE;
+		g_echoComplete = true;
+		if (g_echoCompleteHandler)
+		{
+			g_echoCompleteHandler();
+		}
 	}
 }
 
+// This interrupt handler is called on each edge of the echo pulse. The rising edge is timestamped, and the falling edge
+// completes the reading and notifies the echo complete handler. Both edges see the same interrupt latency, so it cancels
+// out of the pulse width. The logic to send the start pulse, handle timeouts, etc. is handled outside of interrupt context.
+ISR(PCINT0_vect)
+{
+	uint16_t now = echoTimestamp();
+	
+	if (PortB::pin() & g_pinMask)
+	{
+		g_echoStart = now;
+		g_echoStarted = true;
+		uint16_t gateTicks = g_gateTicks;
+		if (gateTicks)
+		{
+			uint16_t gate = now + gateTicks;
+			if ((uint8_t)gate < MIN_GATE_COMPARE)
+			{
+				gate = (gate & 0xFF00) | MIN_GATE_COMPARE;	// A few ticks late, rather than missed
+			}
+			Timer0::compareA() = (uint8_t)gate;
+			g_gateWindow = gate >> 8;
+		}
+	}
+	else if (g_echoStarted && !g_echoComplete)
+	{
+		g_echoTicks = now - g_echoStart;
+		g_echoComplete = true;
+		if (g_echoCompleteHandler)
+		{
+			g_echoCompleteHandler();
+		}
+	}
+}
@@ -9,15 +9,57 @@
 #ifndef __DISTANCESENSOR_H__
 #define __DISTANCESENSOR_H__
 
-#include <avr/io.h>
+#include "Hal.h"
+#include "MedianFilter.h"
+#include "Scheduler.h"
 
-// Abstraction over the Parallax Ping))) sensor. Uses 10uS timer interrupts for very accurate distance readings (< 2mm).
+// Distances are carried as echo ticks: the round-trip echo time in Timer0 counts at F_CPU / ECHO_TIMER_PRESCALER (4uS at
+// 16MHz, about 0.68mm of range), at SPEED_OF_SOUND_CM_PER_SEC, which is the speed in air at 15C. Readings are scaled to
+// that speed for the air temperature (see DistanceSensor), so a distance in echo ticks, or in millimetres converted from
+// them, means the same whatever the temperature. The conversions below are integer-only; with constant arguments they
+// fold at compile time.
+const uint8_t ECHO_TIMER_PRESCALER = 64;
+const uint32_t ECHO_TICKS_PER_SEC = F_CPU / ECHO_TIMER_PRESCALER;
+const uint32_t SPEED_OF_SOUND_CM_PER_SEC = 34029;
+
+#define MM_TO_ECHO_TICKS(mm) ((uint16_t)(((uint32_t)(mm) * (ECHO_TICKS_PER_SEC / 5) + SPEED_OF_SOUND_CM_PER_SEC / 2) / SPEED_OF_SOUND_CM_PER_SEC))
+#define ECHO_TICKS_TO_MM(ticks) ((uint16_t)(((uint32_t)(ticks) * SPEED_OF_SOUND_CM_PER_SEC + ECHO_TICKS_PER_SEC / 10) / (ECHO_TICKS_PER_SEC / 5)))
+
+// Abstraction over one or more Parallax Ping))) sensors, each on its own pin, sharing Timer0, the pin change interrupt
+// and the recovery period. Only one sensor reads at a time: a sensor's burst can be heard by the others, so a reading
+// waits until the previous one, on whichever sensor, has recovered. Sensors with readings requested take turns, round
+// robin, so the interrupt load per reading is the same however many there are. Sensors are registered once, at
+// construction, like scheduler timers; the one passed to the constructor is sensor 0, the default for every call. The
+// table of sensors is sized at compile time by DistanceSensorFixed, below, so firmware with one sensor reserves room for
+// just the one. PB1 and PB4 are the only pins not taken by the LEDs and the button, and PB4 is also the INSTRUMENTATION
+// UART's transmit pin, so a second sensor there can't be built with INSTRUMENTATION.
+//
+// The echo pulse is timed with a pin change interrupt on each edge, stamped
+// against free-running Timer0 (4uS resolution, < 1mm), so a reading costs two interrupts plus one Timer0 overflow per ms.
+// The timeout and the recovery period after a reading are one-shot scheduler timers. The recovery period is chosen from
+// the echo just measured, so readings come several times faster at close range, where they matter most.
+//
+// With a maximum range set, a reading is cut short as soon as the echo passes it and reported as BEYOND_RANGE, so
+// readings of a distant vehicle don't wait out an echo nobody will look at. The gate is a Timer0 compare match, armed on
+// the rising edge of the echo and enabled by the overflow handler once its 256 tick period comes round.
+//
+// The speed of sound changes by about 0.18% per degree C, several centimetres over the range between a winter and a
+// summer garage. Each reading is scaled by a 1.15 fixed-point factor, looked up from the ATtiny85's internal temperature
+// sensor, to what it would have been at 15C. The temperature is measured with the ADC alongside the first reading once
+// TEMPERATURE_INTERVAL has passed (in scheduler time), or after remeasureTemperature(), and applies from the reading
+// after, so a reading only costs one integer multiply.
+//
+// The compensation only helps on a unit whose temperature sensor has been calibrated. Uncalibrated, the sensor can be
+// off by about 10C either way, which scales readings by up to 1.7% in error, as much as the compensation is there to
+// remove. Build each unit with TEMPERATURE_SENSOR_OFFSET defined as the ADC reading the typical response gives at a
+// known temperature (300 at 25C, about 1 count per degree) minus the unit's own reading there; it defaults to zero.
 class DistanceSensor
 {
 //variables
 public:
+	static const uint16_t BEYOND_RANGE = 0xFFFF;
+	static const uint8_t NO_SENSOR = 0xFF;	// From addSensor() when the table is full
 protected:
-private:
 	enum States
 	{
 		IDLE = 0,
@@ -25,38 +67,121 @@ private:
 		RECOVERING			
 	};
 	
-	uint16_t m_capture;
-	bool m_hasCapture;
+	enum TemperatureSteps
+	{
+		TEMPERATURE_IDLE = 0,
+		TEMPERATURE_SETTLING,		// Converting the reading to discard
+		TEMPERATURE_CONVERTING
+	};
+	
+	struct Sensor
+	{
+		uint8_t pinMask;
+		uint16_t capture;
+		uint16_t filteredCapture;
+		uint16_t maxRange;			// Echo ticks, or zero for the sensor's own limit
+		uint16_t gateTicks;			// maxRange at the current temperature, or zero for none
+		uint32_t captureTime;		// Scheduler time the last reading completed
+		bool hasCapture;
+		bool filterEnabled;
+		MedianFilter filter;
+	};
+	
+private:
+	Sensor* m_sensors;
+	uint8_t m_maxSensors;
+	uint8_t m_numSensors;
+	uint8_t m_current;				// The sensor reading, or that read last
+	uint8_t m_requests;				// Bit per sensor with a reading requested
 	uint8_t m_state;
-	uint8_t m_ticksSinceStateChange;
+	Scheduler* m_scheduler;
+	uint8_t m_timer;
+	uint16_t m_speedScale;			// Speed of sound relative to SPEED_OF_SOUND_CM_PER_SEC, 1.15 fixed point
+	uint32_t m_temperatureTime;		// Scheduler time the temperature was last measured
+	bool m_temperatureDue;
+	uint8_t m_temperatureStep;
 	
 //functions
 public:
-	DistanceSensor(uint8_t pin);
 	~DistanceSensor();
 	
-	void startCapture();
-	bool isReadyForCapture();
+	// Registers another sensor, on the given PORTB pin, and returns its id, or NO_SENSOR if the table is full
+	uint8_t addSensor(uint8_t pin);
+	
+	// Requests a reading. It starts straight away if no sensor is reading or recovering, and otherwise once the sensors
+	// requested before it have had their turn. If the sensor's reading is already underway, the request is ignored.
+	void startCapture(uint8_t sensor = 0);
+	bool isReadyForCapture();		// No sensor is reading or recovering
+	bool isCapturing();				// A sensor is reading
+	
+	// Skips the rest of the recovery period after a capture, and drops any capture requested in the meantime. Only for
+	// when the next capture is known to be further off than the recovery period, e.g. because the scheduler is about to
+	// be stopped.
+	void endRecovery();
 	
-	bool hasCapture();
-	float getCapture();
-	float getCaptureAndClear();
+	bool hasCapture(uint8_t sensor = 0);
+	uint16_t getCapture(uint8_t sensor = 0);			// Echo ticks (filtered, if the filter is enabled), zero if the reading timed out, or BEYOND_RANGE
+	uint16_t getCaptureAndClear(uint8_t sensor = 0);
+	uint16_t getRawCapture(uint8_t sensor = 0);			// Latest reading, never filtered
+	uint32_t getCaptureTime(uint8_t sensor = 0);		// Scheduler time the latest reading completed
 	
-	// Call this method with the slow timer interrupt, to capture distance readings and update internal state
-	void tick();
+	// Enables the median filter stage between the raw readings and getCapture()
+	void setFilterEnabled(bool enabled, uint8_t sensor = 0);
+	
+	// Sets the distance, in echo ticks, at and beyond which readings are reported as BEYOND_RANGE, or zero for none.
+	// Applies from the next reading, and restarts the filter so that readings taken without the limit don't mix with
+	// those taken with it.
+	void setMaxRange(uint16_t range, uint8_t sensor = 0);
+	
+	// Has the temperature measured again before the next reading, e.g. when the readings are about to matter after a
+	// long time dormant, during which scheduler time stands still
+	void remeasureTemperature();
+	
+	// Sets a function for the pin change interrupt handler to call, in interrupt context, once the echo pulse has
+	// ended. Typically it posts an event so that main() can call completeCapture(). A reading that times out is
+	// completed by its timer instead, in main(), and shows up in hasCapture().
+	void setEchoCompleteHandler(void (*handler)());
+	
+	// Takes the reading if the echo has ended. Returns true if a capture was completed, for the sensor lastSensor().
+	bool completeCapture();
+	uint8_t lastSensor();
 	
 protected:
+	DistanceSensor(Sensor* sensors, uint8_t maxSensors, Scheduler* scheduler);
 private:
 	void disableInterrupt();
 	void enableInterrupt();
-	float captureTimeToCm(float echoTicks);	
-	bool checkForCompleteCapture();
+	void triggerNext();
+	void trigger(uint8_t sensor);
+	void startTemperature();
+	void convertTemperature();
+	void finishTemperature();
+	void updateGate(Sensor& sensor);
 	void processCapture(uint16_t capture);
-	void checkForCompleteRecovery();
+	static void timerElapsed(void* context);
 	
 	DistanceSensor( const DistanceSensor &c );
 	DistanceSensor& operator=( const DistanceSensor &c );
 
 }; //DistanceSensor
 
+// A DistanceSensor with a table of MaxSensors sensors (at most eight, a bit each in the request mask), with sensor 0 on
+// the given pin
+template <uint8_t MaxSensors = 1>
+class DistanceSensorFixed : public DistanceSensor
+{
+//variables
+private:
+	Sensor m_table[MaxSensors];
+	
+//functions
+public:
+	DistanceSensorFixed(uint8_t pin, Scheduler* scheduler)
+		: DistanceSensor(m_table, MaxSensors, scheduler)
+	{
+		static_assert(MaxSensors >= 1 && MaxSensors <= 8, "DistanceSensorFixed takes one to eight sensors");
+		addSensor(pin);
+	}
+}; //DistanceSensorFixed
+
 #endif //__DISTANCESENSOR_H__
@@ -0,0 +1,33 @@
+/*
+* EepromLayout.h
+*
+* Created: 10/17/2026 11:05:48 AM
+*/
+
+
+#ifndef __EEPROMLAYOUT_H__
+#define __EEPROMLAYOUT_H__
+
+#include "Hal.h"
+#include "SettingsStore.h"
+#include "TraceRecorder.h"
+
+// Everything kept in EEPROM. It is a single object, defined in SettingsStore.cpp, so that the order of its parts is fixed
+// by this declaration rather than by the order the linker happens to place separate EEMEM variables in. New parts go at
+// the end.
+struct EepromLayout
+{
+	// Fixed cells that older firmware saved the stop distance in, before the settings ring. They are only read, once, to
+	// migrate (see ParkingHelper.cpp), and must stay at addresses 0 and 4.
+	uint32_t signature;
+	uint32_t stopDistance;
+	
+	uint8_t settingsRing[SettingsStore::NUM_SLOTS * SettingsStore::RECORD_SIZE];
+#if defined(TRACE)
+	TraceBlock trace;
+#endif
+};
+
+extern EepromLayout EEMEM ee_layout;
+
+#endif //__EEPROMLAYOUT_H__
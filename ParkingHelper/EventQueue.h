@@ -0,0 +1,73 @@
+/*
+* EventQueue.h
+*
+* Created: 10/16/2026 3:05:12 PM
+*/
+
+
+#ifndef __EVENTQUEUE_H__
+#define __EVENTQUEUE_H__
+
+#include <stdint.h>
+
+// Lock-free single-producer/single-consumer ring buffer of one-byte events. Interrupt handlers push and main() pops.
+// Handlers that push must not nest with each other (no ISR_NOBLOCK), so that interrupt context as a whole is the one
+// producer. Each index is written by one side only and is a single byte, so reads and writes of it are atomic on AVR
+// and no interrupts need to be disabled. SIZE must be a power of two; the queue holds at most SIZE - 1 events.
+template <uint8_t SIZE>
+class EventQueue
+{
+//variables
+public:
+protected:
+private:
+	uint8_t m_events[SIZE];
+	volatile uint8_t m_head;	// Next slot to write, owned by the producer
+	volatile uint8_t m_tail;	// Next slot to read, owned by the consumer
+
+//functions
+public:
+	EventQueue()
+		: m_head(0), m_tail(0)
+	{
+	}
+
+	// Producer side. Returns false, dropping the event, if the queue is full.
+	bool push(uint8_t event)
+	{
+		uint8_t head = m_head;
+		uint8_t next = (head + 1) & (SIZE - 1);
+		if (next == m_tail)
+		{
+			return false;
+		}
+		m_events[head] = event;
+		m_head = next;	// Publish only once the event is in place
+		return true;
+	}
+
+	// Consumer side. Returns false if the queue is empty.
+	bool pop(uint8_t& event)
+	{
+		uint8_t tail = m_tail;
+		if (tail == m_head)
+		{
+			return false;
+		}
+		event = m_events[tail];
+		m_tail = (tail + 1) & (SIZE - 1);
+		return true;
+	}
+
+	bool isEmpty() const
+	{
+		return m_tail == m_head;
+	}
+
+private:
+	EventQueue( const EventQueue &c );
+	EventQueue& operator=( const EventQueue &c );
+
+}; //EventQueue
+
+#endif //__EVENTQUEUE_H__
@@ -0,0 +1,24 @@
+/* 
+* Hal.h
+*
+* Created: 10/16/2026 10:02:17 AM
+*/
+
+
+#ifndef __HAL_H__
+#define __HAL_H__
+
+// Hardware abstraction layer. Firmware code reaches the ATtiny85 peripherals only through the policy structs declared
+// here (PortB, Timer0, Timer1, TimerInterrupts, PinChangeInterrupts, Usi, Watchdog, AnalogComparator, Eeprom,
+// Delay, Sleep), so the same sources build for the chip and for the host simulator.
+//
+// On AVR the policies are always-inline accessors returning references to the memory-mapped registers, which compile
+// to exactly the IN/OUT/SBI/CBI instructions of the direct register expressions. On the host they return simulated
+// registers whose reads and writes are modelled by host/HostSimulator.cpp.
+#if defined(__AVR__)
+#include "HalAvr.h"
+#else
+#include "HalHost.h"
+#endif
+
+#endif //__HAL_H__
@@ -0,0 +1,135 @@
+/* 
+* HalAvr.h
+*
+* Created: 10/16/2026 10:02:17 AM
+*/
+
+
+#ifndef __HALAVR_H__
+#define __HALAVR_H__
+
+#include <stddef.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+
+// An 8-bit I/O register
+typedef volatile uint8_t Reg8;
+
+struct PortB
+{
+	static inline __attribute__((always_inline)) Reg8& port() { return PORTB; }
+	static inline __attribute__((always_inline)) Reg8& ddr() { return DDRB; }
+	static inline __attribute__((always_inline)) Reg8& pin() { return PINB; }
+};
+
+struct Timer0
+{
+	static inline __attribute__((always_inline)) Reg8& controlA() { return TCCR0A; }
+	static inline __attribute__((always_inline)) Reg8& controlB() { return TCCR0B; }
+	static inline __attribute__((always_inline)) Reg8& counter() { return TCNT0; }
+	static inline __attribute__((always_inline)) Reg8& compareA() { return OCR0A; }
+	static inline __attribute__((always_inline)) Reg8& compareB() { return OCR0B; }
+};
+
+struct Timer1
+{
+	static inline __attribute__((always_inline)) Reg8& control() { return TCCR1; }
+	static inline __attribute__((always_inline)) Reg8& counter() { return TCNT1; }
+	static inline __attribute__((always_inline)) Reg8& compareA() { return OCR1A; }
+	static inline __attribute__((always_inline)) Reg8& compareB() { return OCR1B; }
+	static inline __attribute__((always_inline)) Reg8& compareC() { return OCR1C; }
+};
+
+// Interrupt mask and flag registers shared by Timer0 and Timer1
+struct TimerInterrupts
+{
+	static inline __attribute__((always_inline)) Reg8& mask() { return TIMSK; }
+	static inline __attribute__((always_inline)) Reg8& flags() { return TIFR; }
+};
+
+struct PinChangeInterrupts
+{
+	static inline __attribute__((always_inline)) Reg8& control() { return GIMSK; }
+	static inline __attribute__((always_inline)) Reg8& flags() { return GIFR; }
+	static inline __attribute__((always_inline)) Reg8& mask() { return PCMSK; }
+};
+
+struct Usi
+{
+	static inline __attribute__((always_inline)) Reg8& control() { return USICR; }
+	static inline __attribute__((always_inline)) Reg8& data() { return USIDR; }
+	static inline __attribute__((always_inline)) Reg8& status() { return USISR; }
+};
+
+struct Watchdog
+{
+	static inline __attribute__((always_inline)) Reg8& control() { return WDTCR; }
+};
+
+struct AnalogComparator
+{
+	static inline __attribute__((always_inline)) Reg8& control() { return ACSR; }
+};
+
+struct Adc
+{
+	static inline __attribute__((always_inline)) Reg8& multiplexer() { return ADMUX; }
+	static inline __attribute__((always_inline)) Reg8& control() { return ADCSRA; }
+	static inline __attribute__((always_inline)) uint16_t result() { return ADC; }	// Reads ADCL, then ADCH
+};
+
+// The EEPROM registers, for byte-at-a-time access driven by EE_RDY_vect, and avr-libc's blocking accessors
+struct Eeprom
+{
+	static inline __attribute__((always_inline)) Reg8& control() { return EECR; }
+	static inline __attribute__((always_inline)) Reg8& data() { return EEDR; }
+	static inline __attribute__((always_inline)) Reg8& addressLow() { return EEARL; }
+	static inline __attribute__((always_inline)) Reg8& addressHigh() { return EEARH; }
+	
+	// EEPROM address of an EEMEM variable, for the address registers
+	static inline __attribute__((always_inline)) uint16_t addressOf(const void* variable) { return (uint16_t)(size_t)variable; }
+	
+	static inline __attribute__((always_inline)) uint32_t readDword(const uint32_t* address) { return eeprom_read_dword(address); }
+};
+
+// Constant tables declared PROGMEM stay in flash, rather than being copied to SRAM at startup, and are read with LPM
+struct Flash
+{
+	static inline __attribute__((always_inline)) uint8_t readByte(const uint8_t* address) { return pgm_read_byte(address); }
+	static inline __attribute__((always_inline)) uint16_t readWord(const uint16_t* address) { return pgm_read_word(address); }
+	static inline __attribute__((always_inline)) uint32_t readDword(const uint32_t* address) { return pgm_read_dword(address); }
+	template <class T> static inline __attribute__((always_inline)) T* readPointer(T* const* address) { return (T*)(size_t)pgm_read_word(address); }
+};
+
+// Busy-wait delays. The duration is a template argument because avr-libc needs it to be a compile-time constant.
+struct Delay
+{
+	template <uint16_t US> static inline __attribute__((always_inline)) void us() { _delay_us(US); }
+	template <uint16_t MS> static inline __attribute__((always_inline)) void ms() { _delay_ms(MS); }
+};
+
+struct Sleep
+{
+	static const uint8_t IDLE = SLEEP_MODE_IDLE;
+	static const uint8_t POWER_DOWN = SLEEP_MODE_PWR_DOWN;
+	
+	// Sleeps until the next interrupt. Interrupts are enabled only once the sleep is armed, so an interrupt that arrives
+	// in between still wakes the CPU (SEI always executes the next instruction before servicing an interrupt).
+	static inline __attribute__((always_inline)) void sleep(uint8_t mode)
+	{
+		set_sleep_mode(mode);
+		cli();
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		// CPU is asleep here
+		sleep_disable();
+	}
+};
+
+#endif //__HALAVR_H__
@@ -0,0 +1,178 @@
+/*
+* Instrumentation.cpp
+*
+* Created: 10/16/2026 9:27:52 PM
+*/
+
+#include "Instrumentation.h"
+
+#if defined(INSTRUMENTATION)
+
+const uint8_t TX_MASK = _BV(PB4);
+const uint8_t UART_BIT_TICKS = 26;		// Timer0 ticks at CPU clock / 64: 104uS, 9615 baud at 16MHz
+const uint32_t RECORD_INTERVAL = MSECS_TO_SCHEDULER_TICKS(10000);
+
+uint16_t g_instrumentationCounters[Instrumentation::NUM_COUNTERS];
+static uint8_t g_longestDispatch = 0;		// Timer0 ticks
+volatile uint8_t g_timer0Overflows = 0;
+static uint8_t g_dispatchOverflows = 0;		// g_timer0Overflows when the dispatch started
+
+volatile static uint8_t g_record[Instrumentation::RECORD_SIZE];	// Record being sent by the interrupt handler
+volatile static uint8_t g_nextByte = 0;		// Index of the byte after the one being sent
+volatile static uint8_t g_shift = 0;		// Data bits of the byte being sent, not yet sent
+volatile static uint8_t g_bit = 0;			// 0 start bit, 1-8 data bits, 9 stop bit
+volatile static bool g_sending = false;
+
+static void recordTimerElapsed(void*)
+{
+	Instrumentation::sendRecord();
+}
+
+void Instrumentation::begin(Scheduler* scheduler)
+{
+	PortB::port() |= TX_MASK;	// Idle high
+	PortB::ddr() |= TX_MASK;
+	Timer0::controlB() = _BV(CS01) | _BV(CS00);	// Pre-scaler -> CPU clock / 64, from now on
+	scheduler->startPeriodic(scheduler->addTimer(recordTimerElapsed, 0), RECORD_INTERVAL);
+}
+
+void Instrumentation::takeTimer0Overflow()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if ((TimerInterrupts::flags() & _BV(TOV0)) && !(TimerInterrupts::mask() & _BV(TOIE0)))
+		{
+			TimerInterrupts::flags() = _BV(TOV0);
+			countTimer0Overflow();
+		}
+	}
+}
+
+// Overflows so far, counting one that is still pending for the distance sensor's overflow handler. The flag is read
+// before the counter, so a pending overflow came before the count read with it.
+static uint8_t readTimer0(uint8_t& counter)
+{
+	Instrumentation::takeTimer0Overflow();
+	uint8_t pending = (TimerInterrupts::flags() & _BV(TOV0)) ? 1 : 0;
+	counter = Timer0::counter();
+	return g_timer0Overflows + pending;
+}
+
+// While neither a capture nor a record is using Timer0's count, it restarts from zero, so that a dispatch that overflows
+// it took the whole 256 ticks or more. Otherwise any two overflows, or one and a count back at or past the start, do.
+uint8_t Instrumentation::startDispatch()
+{
+	uint8_t start;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if (!g_sending && !(TimerInterrupts::mask() & _BV(TOIE0)))
+		{
+			Timer0::counter() = 0;
+			TimerInterrupts::flags() = _BV(TOV0);
+		}
+		g_dispatchOverflows = readTimer0(start);
+	}
+	return start;
+}
+
+// The longest is kept in Timer0 ticks, exact up to a wrap of the 8-bit counter (1.024ms) and 255 beyond
+void Instrumentation::endDispatch(uint8_t start)
+{
+	uint8_t end;
+	uint8_t overflows;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		overflows = readTimer0(end) - g_dispatchOverflows;
+	}
+	uint8_t elapsed = overflows > 1 || (overflows && end >= start) ? 255 : end - start;
+	if (elapsed > g_longestDispatch)
+	{
+		g_longestDispatch = elapsed;
+	}
+}
+
+bool Instrumentation::isBusy()
+{
+	return g_sending;
+}
+
+void Instrumentation::sendRecord()
+{
+	if (g_sending)
+	{
+		return;
+	}
+
+	uint8_t sum = RECORD_SYNC;
+	g_record[0] = RECORD_SYNC;
+	for (uint8_t i = 0; i < NUM_COUNTERS; ++i)
+	{
+		uint16_t value = g_instrumentationCounters[i];
+		g_record[1 + 2 * i] = (uint8_t)value;
+		g_record[2 + 2 * i] = value >> 8;
+		sum += (uint8_t)value + (value >> 8);
+	}
+	g_record[RECORD_SIZE - 2] = g_longestDispatch;
+	g_record[RECORD_SIZE - 1] = sum + g_longestDispatch;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		g_shift = g_record[0];
+		g_nextByte = 1;
+		g_bit = 0;
+		g_sending = true;
+		Timer0::compareB() = Timer0::counter() + UART_BIT_TICKS;
+		TimerInterrupts::flags() = _BV(OCF0B);
+		TimerInterrupts::mask() |= _BV(OCIE0B);
+	}
+}
+
+// This interrupt handler is called at each bit time while a record is being sent. It sets the TX pin for the bit and
+// steps the compare register on to the next, so bits don't drift with the interrupt latency.
+ISR(TIMER0_COMPB_vect)
+{
+	Timer0::compareB() = Timer0::compareB() + UART_BIT_TICKS;
+	Instrumentation::takeTimer0Overflow();	// Often enough that a long dispatch can't see two overflows as one
+	uint8_t bit = g_bit;
+	if (bit == 0)
+	{
+		PortB::port() &= ~TX_MASK;	// Start bit
+	}
+	else if (bit <= 8)
+	{
+		uint8_t shift = g_shift;
+		if (shift & 1)
+		{
+			PortB::port() |= TX_MASK;
+		}
+		else
+		{
+			PortB::port() &= ~TX_MASK;
+		}
+		g_shift = shift >> 1;
+	}
+	else if (bit == 9)
+	{
+		PortB::port() |= TX_MASK;	// Stop bit
+	}
+	else
+	{
+		uint8_t next = g_nextByte;
+		if (next < Instrumentation::RECORD_SIZE)
+		{
+			g_shift = g_record[next];
+			g_nextByte = next + 1;
+			bit = 0;
+			PortB::port() &= ~TX_MASK;	// Start bit of the next byte
+		}
+		else
+		{
+			TimerInterrupts::mask() &= ~_BV(OCIE0B);
+			g_sending = false;
+			return;
+		}
+	}
+	g_bit = bit + 1;
+}
+
+#endif
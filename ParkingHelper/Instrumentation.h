@@ -0,0 +1,111 @@
+/*
+* Instrumentation.h
+*
+* Created: 10/16/2026 9:27:52 PM
+*/
+
+
+#ifndef __INSTRUMENTATION_H__
+#define __INSTRUMENTATION_H__
+
+#include "Hal.h"
+#include "Scheduler.h"
+
+// Run-time counters, streamed as binary records over a transmit-only software UART on PB4 (9615 baud, 8N1), for a
+// look at what the firmware does in the field. Compiled in only when INSTRUMENTATION is defined; otherwise every
+// function is an empty inline and the module costs nothing. PB4 is then no longer free for a second distance sensor.
+//
+// Counting is an increment of a 16-bit counter in SRAM (a few cycles). The counters are cumulative and wrap, so a lost
+// record loses nothing. A record is sent every RECORD_INTERVAL of scheduler time and whenever the device goes idle,
+// since scheduler time all but stops while dormant.
+//
+// The UART bit clock is Timer0 compare B, stepped 26 ticks (104uS) per bit. Timer0 is kept clocked at CPU clock / 64
+// for it, rather than only while the distance sensor is reading, and the time of each event dispatch is measured
+// against it, in 4uS units, saturating at 255 (about 1ms) if the counter wraps. Its overflows are counted from TOV0,
+// which is polled here except during a capture, when the distance sensor's overflow handler counts them instead.
+//
+// Record, 15 bytes: RECORD_SYNC, the counters in Counters order (16-bit, little endian), the longest dispatch, and the
+// 8-bit sum of all the bytes before it.
+class Instrumentation
+{
+//variables
+public:
+	enum Counters
+	{
+		CAPTURES = 0,
+		TIMEOUTS,
+		MOTION_WAKEUPS,
+		STATE_CHANGES,
+		SHOWS,				// Frames shown by LedSequencer and ParkingHelper, including those the strip skips as unchanged
+		LATE_TIMERS,		// Scheduler callbacks run a Timer1 period or more after their deadline
+		NUM_COUNTERS
+	};
+
+	static const uint8_t RECORD_SYNC = 0xA5;
+	static const uint8_t RECORD_SIZE = 3 + 2 * NUM_COUNTERS;
+
+#if defined(INSTRUMENTATION)
+	static const bool ENABLED = true;
+#else
+	static const bool ENABLED = false;
+#endif
+protected:
+private:
+
+//functions
+public:
+#if defined(INSTRUMENTATION)
+	// Takes over PB4 and Timer0's clock, and starts the record timer
+	static void begin(Scheduler* scheduler);
+
+	static void count(uint8_t counter);
+
+	// Bracket an event dispatch
+	static uint8_t startDispatch();
+	static void endDispatch(uint8_t start);
+
+	// For the distance sensor: counts a Timer0 overflow taken by its overflow handler, and takes a pending one before
+	// the sensor clears the flag to enable that handler
+	static void countTimer0Overflow();
+	static void takeTimer0Overflow();
+
+	// Starts sending a record, unless one is still being sent
+	static void sendRecord();
+
+	// A record is being sent. Don't power down, as Timer0 stops.
+	static bool isBusy();
+#else
+	static inline void begin(Scheduler*) {}
+	static inline void count(uint8_t) {}
+	static inline uint8_t startDispatch() { return 0; }
+	static inline void endDispatch(uint8_t) {}
+	static inline void countTimer0Overflow() {}
+	static inline void takeTimer0Overflow() {}
+	static inline void sendRecord() {}
+	static inline bool isBusy() { return false; }
+#endif
+
+protected:
+private:
+	Instrumentation();
+	Instrumentation( const Instrumentation &c );
+	Instrumentation& operator=( const Instrumentation &c );
+
+}; //Instrumentation
+
+#if defined(INSTRUMENTATION)
+extern uint16_t g_instrumentationCounters[Instrumentation::NUM_COUNTERS];
+extern volatile uint8_t g_timer0Overflows;
+
+inline void Instrumentation::count(uint8_t counter)
+{
+	++g_instrumentationCounters[counter];
+}
+
+inline void Instrumentation::countTimer0Overflow()
+{
+	g_timer0Overflows = g_timer0Overflows + 1;
+}
+#endif
+
+#endif //__INSTRUMENTATION_H__
@@ -1,7 +1,8 @@
 #ifndef __LPD8806TINY_H__
 #define __LPD8806TINY_H__
 
-#include <avr/io.h>
+#include "Hal.h"
+#include <string.h>
 
 struct Color
 {
@@ -249,29 +250,221 @@ struct Color
 
 
 
+// Gamma 2.5 curve from 8-bit levels to the LPD8806's 7-bit PWM levels, so that equal steps in a color look like equal
+// steps in brightness. The levels are 7.8 fixed point, keeping the fraction for dithering.
+extern const uint16_t lpd8806Gamma[256] PROGMEM;
+
+// Encodes one 8-bit level as a wire byte: gamma-corrected, scaled by the brightness (255 is full), with the high bit set.
+// With dithering, the PWM level is rounded down and the fraction below it is stored for show() to make up over
+// successive frames; otherwise it is rounded to nearest.
+static inline uint8_t lpd8806Encode(uint8_t level, uint8_t brightness, uint8_t *fraction) __attribute__((always_inline));
+static inline uint8_t lpd8806Encode(uint8_t level, uint8_t brightness, uint8_t *fraction) {
+	uint16_t pwm = Flash::readWord(&lpd8806Gamma[level]);
+	if(brightness != 255) {
+		// pwm * (brightness + 1) / 256, without a 32-bit multiply
+		pwm = (uint16_t)(pwm >> 8) * (brightness + 1) + (((pwm & 0xFF) * (brightness + 1)) >> 8);
+	}
+	if(fraction) {
+		*fraction = pwm & 0xFF;
+		return (pwm >> 8) | 0x80;
+	}
+	return ((pwm + 0x80) >> 8) | 0x80;
+}
+
+// Stores one pixel's color, and its wire bytes, returning 'true' only if the color differs from what is already there.
+// Our LPD8806 strip color order is BRG (AdaFruit code was GRB), not the more common RGB. The colors are kept in the same
+// order as the wire bytes, so that the whole buffer can be re-encoded when the brightness changes. fractions is NULL
+// unless dithering.
+static inline bool lpd8806StorePixel(uint8_t *wire, uint8_t *c, uint8_t *fractions, uint8_t r, uint8_t g, uint8_t b, uint8_t brightness) __attribute__((always_inline));
+static inline bool lpd8806StorePixel(uint8_t *wire, uint8_t *c, uint8_t *fractions, uint8_t r, uint8_t g, uint8_t b, uint8_t brightness) {
+	if(c[0] == b && c[1] == r && c[2] == g) return false;
+	c[0] = b;
+	c[1] = r;
+	c[2] = g;
+	wire[0] = lpd8806Encode(b, brightness, fractions);
+	wire[1] = lpd8806Encode(r, brightness, fractions ? fractions + 1 : 0);
+	wire[2] = lpd8806Encode(g, brightness, fractions ? fractions + 2 : 0);
+	return true;
+}
+
+// Re-encodes every wire byte from the stored colors, for a new brightness or dithering mode
+static inline void lpd8806Reencode(uint8_t *wire, const uint8_t *c, uint8_t *fractions, uint16_t n, uint8_t brightness) {
+	while(n--) {
+		*wire++ = lpd8806Encode(*c++, brightness, fractions);
+		if(fractions) ++fractions;
+	}
+}
+
+// Temporal dithering of one wire byte. The fraction is added to the pixel's error accumulator each frame, and each time
+// it carries the byte goes out one PWM level higher, so over 256 frames the level averages out to the 7.8 fixed-point
+// value. A level with a fraction is always below 127, so the carry never overflows into the flag bit.
+static inline uint8_t lpd8806Dither(uint8_t wire, uint8_t *error, uint8_t fraction) __attribute__((always_inline));
+static inline uint8_t lpd8806Dither(uint8_t wire, uint8_t *error, uint8_t fraction) {
+	uint8_t sum = *error + fraction;
+	if(sum < fraction) ++wire;
+	*error = sum;
+	return wire;
+}
+
+// Shifts one byte out of the USI in three-wire mode. The USI shifts the MSB of USIDR out on DO. Each pair of strobes
+// raises USCK (the strip samples DO), then lowers it and shifts the next bit into place, so a bit costs two OUT
+// instructions (an 8MHz clock, well within the LPD8806's limit on short wiring). The strobes are unrolled to keep the
+// loop overhead out of the clock timing.
+static inline void lpd8806UsiShiftOut(uint8_t data) __attribute__((always_inline));
+static inline void lpd8806UsiShiftOut(uint8_t data) {
+	const uint8_t clkHigh = _BV(USIWM0) | _BV(USITC);
+	const uint8_t clkLow  = _BV(USIWM0) | _BV(USITC) | _BV(USICLK);
+	Usi::data() = data;
+	Usi::control() = clkHigh; Usi::control() = clkLow;
+	Usi::control() = clkHigh; Usi::control() = clkLow;
+	Usi::control() = clkHigh; Usi::control() = clkLow;
+	Usi::control() = clkHigh; Usi::control() = clkLow;
+	Usi::control() = clkHigh; Usi::control() = clkLow;
+	Usi::control() = clkHigh; Usi::control() = clkLow;
+	Usi::control() = clkHigh; Usi::control() = clkLow;
+	Usi::control() = clkHigh; Usi::control() = clkLow;
+}
+
 // rbg
+// Frames are pushed with the USI in three-wire mode when the strip is wired to the USI pins (data on DO/PB1, clock on
+// USCK/PB2), and bit-banged on PORTB for any other pin pair.
 class LPD8806 {
 
 	public:
 	
-	LPD8806(uint16_t n, uint8_t dpin, uint8_t cpin); // Configurable pins
+	LPD8806(uint16_t n, uint8_t dpin, uint8_t cpin); // Configurable pins, output backend chosen from the pin pair
 	void begin();
-	void show();
+	void show();      // Pushes the frame, or returns immediately if no pixel changed since the last push
 	void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
 	void setPixelColor(uint16_t n, const Color& color);
+	void setBrightness(uint8_t b); // Scales every color, 255 is full. Re-encodes the buffer once, and the frame is pushed on the next show()
+	void setDithering(bool on); // Temporal dithering, for smooth levels when dim. show() then pushes every call, so call it at a fixed rate
 	void updatePins(uint8_t dpin, uint8_t cpin); // Change pins, configurable
 	void updateLength(uint16_t n); // Change strip length
 	uint16_t numPixels(void);
 	
 	private:
 	uint16_t numLEDs; // Number of RGB LEDs in strip
-	uint8_t *pixels;	// Holds LED color values (3 bytes each)
+	uint8_t *pixels;	// Holds LED wire bytes (3 bytes each) + 1 for latch
+	uint8_t *colors;	// Holds LED color values (3 bytes each), in the same order as the wire bytes
+	uint8_t *fractions;	// Holds the PWM level fraction below each wire byte, while dithering
+	uint8_t *errors;	// Holds the dithering error accumulator of each wire byte
+	uint8_t brightness;
 	uint8_t clkpin;	// Clock pin number
 	uint8_t datapin;	// Data pin number
 	uint8_t clkpinmask;	// Clock PORT bitmask
 	uint8_t datapinmask;	// Data PORT bitmask
 	void startBitbang(void);
+	void startUsi(void);
+	void showBitbang(void);
+	void showUsi(void);
+	bool useUsi;      // If 'true', pins are the USI DO/USCK pins and bytes are shifted out by the USI
+	bool dirty;       // If 'true', pixels changed since the last show()
+	bool dither;      // If 'true', wire bytes are dithered with the fractions on each show()
 	bool begun;       // If 'true', begin() method was previously invoked
 };
 
+// Fixed-length strip on fixed pins. Same interface as LPD8806, but the pixel buffer is statically sized (no heap), and
+// the strip length and pin masks are compile-time constants, so the bit-bang loop compiles to SBI/CBI instructions and
+// the USI/bit-bang backend choice is resolved by the compiler. Dithering (see LPD8806::setDithering()) is chosen at compile
+// time too, so that its buffers only take up SRAM when it is used.
+template <uint16_t N, uint8_t DataPin, uint8_t ClockPin, bool Dither = false>
+class LPD8806Fixed {
+
+	public:
+	static const uint16_t NUM_PIXELS = N;
+	
+	LPD8806Fixed() : brightness(255), dirty(true) {
+		memset(pixels, 0x80, N * 3); // Init to RGB 'off' state
+		memset(colors, 0, N * 3);
+		memset(fractions, 0, sizeof(fractions));
+		memset(errors, 0, sizeof(errors));
+	}
+
+	// Set outputs for the selected backend and issue initial latch:
+	void begin() {
+		PortB::ddr()  |= DATA_MASK;
+		PortB::ddr()  |= CLOCK_MASK;
+		PortB::port() &= ~DATA_MASK;  // Data is held low throughout (latch = 0)
+		PortB::port() &= ~CLOCK_MASK;
+		if(USE_USI) {
+			Usi::control() = _BV(USIWM0);  // Three-wire mode, no clock source until strobed
+			lpd8806UsiShiftOut(0);
+		} else {
+			for(uint8_t i = 8; i>0; i--) {
+				PortB::port() |=  CLOCK_MASK;
+				PortB::port() &= ~CLOCK_MASK;
+			}
+		}
+	}
+
+	// Pushes the frame, or returns immediately if no pixel changed since the last push. With dithering, every call pushes
+	// a frame, and should be made at a fixed rate.
+	void show() {
+		if(!dirty && !Dither) return; // Wire buffer unchanged, the strip already shows this frame
+		dirty = false;
+		
+		const uint8_t *p = pixels, *end = pixels + N * 3;
+		uint8_t *error = errors;
+		const uint8_t *fraction = fractions;
+		while (p != end) {
+			uint8_t pixel = *p++;	// Already encoded by setPixelColor()
+			if(Dither) pixel = lpd8806Dither(pixel, error++, *fraction++);
+			shiftOut(pixel);
+		}
+		shiftOut(0);	// Latch
+	}
+	
+	// Set pixel color from separate 8-bit R, G, B components:
+	void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+		if(n < N) { // Arrays are 0-indexed, thus NOT '<='
+			if(lpd8806StorePixel(&pixels[n * 3], &colors[n * 3], Dither ? &fractions[n * 3] : 0, r, g, b, brightness)) dirty = true;
+		}
+	}
+	
+	void setPixelColor(uint16_t n, const Color& color) {
+		if(n < N) { // Arrays are 0-indexed, thus NOT '<='
+			if(lpd8806StorePixel(&pixels[n * 3], &colors[n * 3], Dither ? &fractions[n * 3] : 0, color.r, color.g, color.b, brightness)) dirty = true;
+		}
+	}
+	
+	// Scales every color, 255 is full. Re-encodes the buffer once, and the frame is pushed on the next show().
+	void setBrightness(uint8_t b) {
+		if(b == brightness) return;
+		brightness = b;
+		lpd8806Reencode(pixels, colors, Dither ? fractions : 0, N * 3, brightness);
+		dirty = true;
+	}
+	
+	static uint16_t numPixels(void) {
+		return N;
+	}
+	
+	private:
+	static const uint8_t DATA_MASK  = 1 << DataPin;
+	static const uint8_t CLOCK_MASK = 1 << ClockPin;
+	static const bool USE_USI = (DataPin == PB1) && (ClockPin == PB2); // USI DO and USCK on the ATtiny85
+	
+	uint8_t pixels[N * 3];		// Holds LED wire bytes (3 bytes each)
+	uint8_t colors[N * 3];		// Holds LED color values (3 bytes each), in the same order as the wire bytes
+	uint8_t fractions[Dither ? N * 3 : 1];	// Holds the PWM level fraction below each wire byte
+	uint8_t errors[Dither ? N * 3 : 1];		// Holds the dithering error accumulator of each wire byte
+	uint8_t brightness;
+	bool dirty;       // If 'true', pixels changed since the last show()
+	
+	static inline __attribute__((always_inline)) void shiftOut(uint8_t pixel) {
+		if(USE_USI) {
+			lpd8806UsiShiftOut(pixel);
+		} else {
+			for (uint8_t bit = 8; bit; --bit) {
+				if(pixel & 0x80) PortB::port() |=  DATA_MASK;
+				else             PortB::port() &= ~DATA_MASK;
+				PortB::port() |=  CLOCK_MASK;
+				pixel <<= 1;
+				PortB::port() &= ~CLOCK_MASK;
+			}
+		}
+	}
+};
+
 #endif //__LPD8806TINY_H__
@@ -10,54 +10,389 @@
 #define __LEDSEQUENCER_H__
 
 #include "LPD8806tiny.h"
-#include <avr/io.h>
+#include "Instrumentation.h"
+#include "Scheduler.h"
+#include <stddef.h>
 
 #define NELEMS(A) (sizeof(A) / sizeof A[0])
 
+// A pattern is one color table index per LED. Segments, the patterns they point to and the color table all live in
+// flash (PROGMEM), and the sequencer reads them from there.
 struct Segment
 {
-	uint8_t* pattern;
+	const uint8_t* pattern;
 	uint8_t duration;
+	bool fade;		// Crossfade to the next segment's pattern over the duration, if the LedSequencer has Fade set
 };
 
-//struct Sequence
-//{
-	//Segment* segments;
-	//uint8_t numSegments;
-//};
+// Compile-time generation of pattern and segment tables, so that they follow the strip length. A pattern generator
+// returns the color index of a given LED in a given pattern of the table, and a segment generator returns a given
+// segment. Both are constexpr functions, expanded over the table's indices, so the table is a constant initializer
+// that can go in flash.
+template <uint8_t... I> struct IndexList {};
+template <uint8_t N, uint8_t... I> struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+template <uint8_t... I> struct MakeIndexList<0, I...> { typedef IndexList<I...> Type; };
 
-// Manages an LED strip so as to make the lights blink
+template <uint8_t LEDS> struct Pattern { uint8_t colors[LEDS]; };
+template <uint8_t LEDS, uint8_t COUNT> struct PatternTable { Pattern<LEDS> patterns[COUNT]; };
+template <uint8_t COUNT> struct SegmentTable { Segment segments[COUNT]; };
+
+typedef uint8_t (*PatternGenerator)(uint8_t pattern, uint8_t led);
+typedef Segment (*SegmentGenerator)(uint8_t segment);
+
+template <uint8_t LEDS, PatternGenerator G, uint8_t... L>
+constexpr Pattern<LEDS> generatePattern(uint8_t pattern, IndexList<L...>)
+{
+	return Pattern<LEDS>{ { G(pattern, L)... } };
+}
+
+template <uint8_t LEDS, PatternGenerator G, uint8_t... P>
+constexpr PatternTable<LEDS, sizeof...(P)> generatePatterns(IndexList<P...>)
+{
+	return PatternTable<LEDS, sizeof...(P)>{ { generatePattern<LEDS, G>(P, typename MakeIndexList<LEDS>::Type())... } };
+}
+
+template <uint8_t LEDS, uint8_t COUNT, PatternGenerator G>
+constexpr PatternTable<LEDS, COUNT> generatePatterns()
+{
+	return generatePatterns<LEDS, G>(typename MakeIndexList<COUNT>::Type());
+}
+
+template <SegmentGenerator G, uint8_t... S>
+constexpr SegmentTable<sizeof...(S)> generateSegments(IndexList<S...>)
+{
+	return SegmentTable<sizeof...(S)>{ { G(S)... } };
+}
+
+template <uint8_t COUNT, SegmentGenerator G>
+constexpr SegmentTable<COUNT> generateSegments()
+{
+	return generateSegments<G>(typename MakeIndexList<COUNT>::Type());
+}
+
+// Manages an LED strip so as to make the lights blink. Strip is any LPD8806-like type (LPD8806, LPD8806Fixed<>) providing
+// numPixels(), setPixelColor() and show(). The color table holds 0xRRGGBB color codes. Each segment is shown for its
+// duration times the tick divisor, in milliseconds, timed by a one-shot scheduler timer.
+//
+// With Fade set, a fading segment steps from its own pattern to the next segment's in frames FADE_FRAME_MSECS apart, then
+// the next segment starts as usual. Each color channel of each pixel has an 8.8 fixed-point level and a step, worked out
+// once when the fade starts, so a frame is one add per channel. The last segment of a sequence only fades if the sequence
+// goes round again (it repeats, or has plays left), in which case it fades to the first. The fade state takes 12 bytes
+// of SRAM per pixel, so Fade is chosen at compile time and is off by default. NumPixels sizes the fade state, and must be
+// given for a strip whose length is not a compile-time constant.
+//
+// A finite sequence can be played over the top of the current one with playSequence(), e.g. to confirm something.
+// While it plays, sequences started in the meantime are held back; the latest of them (or else whatever was showing
+// before) takes over once it finishes.
+template <class Strip, bool Fade = false, uint16_t NumPixels = Strip::NUM_PIXELS>
 class LedSequencer
 {
+public:
+	static const uint8_t FADE_FRAME_MSECS = 20;
 private:
-	LPD8806* m_leds;
-	const Color* m_colorTable;
+	static const uint16_t FADE_PIXELS = Fade ? NumPixels : 0;
+	
+
+	Strip* m_leds;
+	const uint32_t* m_colorTable;
 	uint8_t m_colorTableLength;
-	Segment* m_segments;
+	const Segment* m_segments;
 	uint8_t m_numSegments;
 	uint8_t m_currentSegmentIndex;
-	uint8_t m_currentSegmentProgress;
 	bool m_autoRepeat;
 	uint8_t m_tickDivisor;
-	uint8_t m_subTickCount;
+	const uint8_t* m_shownPattern;	// Pattern currently on the strip, or NULL if unknown
+	Scheduler* m_scheduler;
+	uint8_t m_timer;
+	uint8_t m_playsLeft;			// Non-zero while a sequence from playSequence() is showing
+	const Segment* m_resumeSegments;		// Sequence to show once it has finished
+	uint8_t m_resumeNumSegments;
+	bool m_resumeAutoRepeat;
+	uint8_t m_fadeFramesLeft;		// Non-zero while a fade is in progress
+	uint32_t m_fadeLastTicks;		// From the last fade frame until the end of the segment
+	uint16_t m_fadeLevels[Fade ? NumPixels : 1][3];
+	int16_t m_fadeSteps[Fade ? NumPixels : 1][3];
 	
 public:
-	LedSequencer(LPD8806* leds, const Color* colorTable, uint8_t colorTableLength, uint8_t tickDivisor);
+	LedSequencer(Strip* leds, const uint32_t* colorTable, uint8_t colorTableLength, uint8_t tickDivisor, Scheduler* scheduler);
 	~LedSequencer();
-	void startSequenceIfDifferent(Segment* segments, uint8_t numSegments, bool autoRepeat);
-	void startSequence(Segment* segments, uint8_t numSegments, bool autoRepeat);
-	void playSequence(Segment* segments, uint8_t numSegments, uint8_t millisecondsPerTick);
-	bool tick();
+	void startSequenceIfDifferent(const Segment* segments, uint8_t numSegments, bool autoRepeat);
+	void startSequence(const Segment* segments, uint8_t numSegments, bool autoRepeat);
+	
+	// Plays a sequence the given number of times, without blocking, then goes back to the sequence it interrupted
+	void playSequence(const Segment* segments, uint8_t numSegments, uint8_t plays);
+	bool isPlaying();
+	
 	bool isSequenceActive();
 	void clear();
+	
+	// Takes effect from the next segment
 	void setTickDivisor(uint8_t tickDivisor);
 protected:
 private:
 	LedSequencer( const LedSequencer &c );
 	LedSequencer& operator=( const LedSequencer &c );
-	void showSegment(const Segment& segment);
-	bool nextSegment();
+	void show(const Segment* segments, uint8_t numSegments, bool autoRepeat);
+	void showSegment(const Segment* segment);
+	void showFrame();
+	void startSegmentTimer();
+	const Segment* fadeTarget();
+	void startFade(const uint8_t* target, uint8_t frames);
+	void fadeFrame();
+	void nextSegment();
+	static void segmentElapsed(void* context);
 	
 }; //LedSequencer
 
+// default constructor
+template <class Strip, bool Fade, uint16_t NumPixels>
+LedSequencer<Strip, Fade, NumPixels>::LedSequencer(Strip* leds, const uint32_t* colorTable, uint8_t colorTableLength, uint8_t tickDivisor, Scheduler* scheduler)
+	:m_leds(leds), m_colorTable(colorTable), m_colorTableLength(colorTableLength), m_segments(0), m_autoRepeat(false), m_tickDivisor(tickDivisor), m_shownPattern(0),
+	m_scheduler(scheduler), m_playsLeft(0), m_resumeSegments(0), m_fadeFramesLeft(0)
+{
+	m_timer = m_scheduler->addTimer(segmentElapsed, this);
+} //LedSequencer
+
+// default destructor
+template <class Strip, bool Fade, uint16_t NumPixels>
+LedSequencer<Strip, Fade, NumPixels>::~LedSequencer()
+{
+} //~LedSequencer
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::startSequenceIfDifferent(const Segment* segments, uint8_t numSegments, bool autoRepeat)
+{
+	if ((m_playsLeft ? m_resumeSegments : m_segments) != segments)
+	{
+		startSequence(segments, numSegments, autoRepeat);
+	}
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::startSequence(const Segment* segments, uint8_t numSegments, bool autoRepeat)
+{
+	if (m_playsLeft)
+	{
+		// Takes over once the played sequence has finished
+		m_resumeSegments = segments;
+		m_resumeNumSegments = numSegments;
+		m_resumeAutoRepeat = autoRepeat;
+		return;
+	}
+	show(segments, numSegments, autoRepeat);
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::playSequence(const Segment* segments, uint8_t numSegments, uint8_t plays)
+{
+	if (!m_playsLeft)
+	{
+		m_resumeSegments = isSequenceActive() ? m_segments : 0;
+		m_resumeNumSegments = m_numSegments;
+		m_resumeAutoRepeat = m_autoRepeat;
+	}
+	m_playsLeft = plays;
+	show(segments, numSegments, false);
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+bool LedSequencer<Strip, Fade, NumPixels>::isPlaying()
+{
+	return m_playsLeft != 0;
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::show(const Segment* segments, uint8_t numSegments, bool autoRepeat)
+{
+	m_segments = segments;
+	m_numSegments = numSegments;
+	m_autoRepeat = autoRepeat;
+	m_currentSegmentIndex = 0;
+	m_fadeFramesLeft = 0;
+	
+	showSegment(&m_segments[m_currentSegmentIndex]);
+	startSegmentTimer();
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::clear()
+{
+	m_numSegments = 0;
+	m_segments = 0;
+	m_shownPattern = 0;
+	m_playsLeft = 0;
+	m_resumeSegments = 0;
+	m_fadeFramesLeft = 0;
+	m_scheduler->cancel(m_timer);
+	for (uint16_t i = 0; i < m_leds->numPixels(); ++i)
+	{
+		m_leds->setPixelColor(i, Color::Black);
+	}
+	showFrame();
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::setTickDivisor(uint8_t tickDivisor)
+{
+	m_tickDivisor = tickDivisor;
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::startSegmentTimer()
+{
+	const Segment* segment = &m_segments[m_currentSegmentIndex];
+	uint16_t millis = (uint16_t)Flash::readByte(&segment->duration) * m_tickDivisor;
+	uint32_t ticks = MSECS_TO_SCHEDULER_TICKS(millis);
+	
+	const Segment* target = Fade && Flash::readByte((const uint8_t*)&segment->fade) ? fadeTarget() : 0;
+	if (target && millis >= 2 * FADE_FRAME_MSECS)
+	{
+		// Frames 1 to frames - 1 are in between; the target itself is shown when the next segment starts
+		uint16_t frames = millis / FADE_FRAME_MSECS;
+		if (frames > 255)
+		{
+			frames = 255;
+		}
+		uint32_t frameTicks = ticks / frames;
+		startFade(Flash::readPointer(&target->pattern), frames);
+		m_fadeFramesLeft = frames - 1;
+		m_fadeLastTicks = ticks - frameTicks * m_fadeFramesLeft;
+		m_scheduler->startPeriodic(m_timer, frameTicks);
+		return;
+	}
+	m_scheduler->startOneShot(m_timer, ticks);
+}
+
+// Returns the segment that the current one fades to, or NULL if it is the last one to be shown
+template <class Strip, bool Fade, uint16_t NumPixels>
+const Segment* LedSequencer<Strip, Fade, NumPixels>::fadeTarget()
+{
+	if (m_currentSegmentIndex + 1 < m_numSegments)
+	{
+		return &m_segments[m_currentSegmentIndex + 1];
+	}
+	return (m_playsLeft > 1 || (!m_playsLeft && m_autoRepeat)) ? m_segments : 0;
+}
+
+// Change in an 8.8 fixed-point level per frame. The magnitude is worked out unsigned, as a 16-bit division is much
+// cheaper than a 32-bit one on the AVR.
+static inline int16_t fadeStep(uint8_t from, uint8_t to, uint8_t frames)
+{
+	if (to >= from)
+	{
+		return ((uint16_t)(to - from) << 8) / frames;
+	}
+	return -(int16_t)(((uint16_t)(from - to) << 8) / frames);
+}
+
+// Sets each channel's level to the current pattern (which is on the strip) and its step to reach the target pattern in
+// the given number of frames. The only divisions are here, once per channel per fade.
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::startFade(const uint8_t* target, uint8_t frames)
+{
+	for (uint16_t i = 0; i < FADE_PIXELS; ++i)
+	{
+		Color from(Flash::readDword(&m_colorTable[Flash::readByte(&m_shownPattern[i])]));
+		Color to(Flash::readDword(&m_colorTable[Flash::readByte(&target[i])]));
+		for (uint8_t c = 0; c < 3; ++c)
+		{
+			m_fadeLevels[i][c] = ((uint16_t)from[c] << 8) | 0x80;	// Half way up, so that truncating rounds to nearest
+			m_fadeSteps[i][c] = fadeStep(from[c], to[c], frames);
+		}
+	}
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::fadeFrame()
+{
+	for (uint16_t i = 0; i < FADE_PIXELS; ++i)
+	{
+		uint16_t* levels = m_fadeLevels[i];
+		const int16_t* steps = m_fadeSteps[i];
+		levels[0] += steps[0];
+		levels[1] += steps[1];
+		levels[2] += steps[2];
+		m_leds->setPixelColor(i, levels[0] >> 8, levels[1] >> 8, levels[2] >> 8);
+	}
+	showFrame();
+	m_shownPattern = 0;	// In between patterns
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::segmentElapsed(void* context)
+{
+	LedSequencer* sequencer = (LedSequencer*)context;
+	if (Fade && sequencer->m_fadeFramesLeft)
+	{
+		sequencer->fadeFrame();
+		if (--sequencer->m_fadeFramesLeft == 0)
+		{
+			sequencer->m_scheduler->startOneShot(sequencer->m_timer, sequencer->m_fadeLastTicks);
+		}
+		return;
+	}
+	sequencer->nextSegment();
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::nextSegment()
+{
+	++m_currentSegmentIndex;
+	if (m_currentSegmentIndex >= m_numSegments)
+	{
+		if (m_playsLeft && --m_playsLeft == 0)
+		{
+			// Finished playing; go back to what it interrupted, or to a blank strip
+			if (m_resumeSegments)
+			{
+				show(m_resumeSegments, m_resumeNumSegments, m_resumeAutoRepeat);
+			}
+			else
+			{
+				clear();
+			}
+			return;
+		}
+		if (!m_playsLeft && !m_autoRepeat)
+		{
+			return;	// Leave the last segment showing
+		}
+		m_currentSegmentIndex = 0;
+	}
+	
+	showSegment(&m_segments[m_currentSegmentIndex]);
+	startSegmentTimer();
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::showFrame()
+{
+	Instrumentation::count(Instrumentation::SHOWS);
+	m_leds->show();
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+void LedSequencer<Strip, Fade, NumPixels>::showSegment(const Segment* segment)
+{
+	const uint8_t* pattern = Flash::readPointer(&segment->pattern);
+	if (pattern == m_shownPattern)
+	{
+		// Already on the strip, e.g. a single-segment sequence restarting
+		return;
+	}
+	m_shownPattern = pattern;
+	
+	for (uint16_t i = 0; i < m_leds->numPixels(); ++i)
+	{
+		m_leds->setPixelColor(i, Color(Flash::readDword(&m_colorTable[Flash::readByte(&pattern[i])])));
+	}
+	showFrame();
+}
+
+template <class Strip, bool Fade, uint16_t NumPixels>
+bool LedSequencer<Strip, Fade, NumPixels>::isSequenceActive()
+{
+	return !(m_segments == NULL || m_currentSegmentIndex >= m_numSegments);
+}
+
 #endif //__LEDSEQUENCER_H__
@@ -0,0 +1,76 @@
+/* 
+* MedianFilter.h
+*
+* Created: 10/16/2026 9:12:40 AM
+*/
+
+
+#ifndef __MEDIANFILTER_H__
+#define __MEDIANFILTER_H__
+
+#include <stdint.h>
+
+// Running median over the last three distance readings. A single spurious echo (or a single dropout) never reaches the
+// output, while a genuine change comes through on the second reading. Fixed cost per sample: one store and at most
+// three compares.
+class MedianFilter
+{
+//variables
+public:
+	static const uint8_t WINDOW = 3;
+protected:
+private:
+	uint16_t m_samples[WINDOW];
+	uint8_t m_next;
+	bool m_primed;
+
+//functions
+public:
+	MedianFilter()
+		: m_next(0), m_primed(false)
+	{
+	}
+	
+	// Adds a sample and returns the median of the window. The first sample after a reset fills the whole window.
+	uint16_t add(uint16_t sample)
+	{
+		if (!m_primed)
+		{
+			m_samples[0] = m_samples[1] = m_samples[2] = sample;
+			m_primed = true;
+		}
+		else
+		{
+			m_samples[m_next] = sample;
+			if (++m_next == WINDOW)
+			{
+				m_next = 0;
+			}
+		}
+		return median();
+	}
+	
+	void reset()
+	{
+		m_next = 0;
+		m_primed = false;
+	}
+	
+private:
+	uint16_t median() const
+	{
+		uint16_t lo = m_samples[0];
+		uint16_t hi = m_samples[1];
+		if (lo > hi)
+		{
+			lo = m_samples[1];
+			hi = m_samples[0];
+		}
+		// Median is the third sample clamped to [lo, hi]
+		uint16_t c = m_samples[2];
+		return c < lo ? lo : (c > hi ? hi : c);
+	}
+
+}; //MedianFilter
+
+#endif //__MEDIANFILTER_H__
@@ -0,0 +1,66 @@
+/*
+* MotionTracker.cpp
+*
+* Created: 10/16/2026 8:41:05 PM
+*/
+
+#include "MotionTracker.h"
+
+const uint8_t POSITION_SHIFT = 4;
+const uint8_t ALPHA_SHIFT = 1;
+const uint8_t BETA_SHIFT = 3;
+const uint8_t MAX_INTERVAL = 255;						// Scheduler ticks; readings further apart restart the track
+const int32_t MAX_RESIDUAL = 512L << POSITION_SHIFT;	// About 35cm, more than a vehicle moves between readings
+const int16_t MAX_VELOCITY = 8 << 8;					// About 5m/s
+
+// default constructor
+MotionTracker::MotionTracker()
+	: m_position(0), m_velocity(0), m_time(0), m_interval(0), m_tracking(false)
+{
+} //MotionTracker
+
+// default destructor
+MotionTracker::~MotionTracker()
+{
+} //~MotionTracker
+
+void MotionTracker::reset()
+{
+	m_tracking = false;
+}
+
+void MotionTracker::update(uint16_t distance, uint32_t time)
+{
+	int32_t measured = (int32_t)distance << POSITION_SHIFT;
+	uint32_t elapsed = time - m_time;
+	m_time = time;
+	if (!m_tracking || elapsed == 0 || elapsed > MAX_INTERVAL)
+	{
+		m_position = measured;
+		m_velocity = 0;
+		m_interval = 0;
+		m_tracking = true;
+		return;
+	}
+	m_interval = (uint8_t)elapsed;
+
+	// Velocity is 8 fractional bits and position 4, so the product has 4 too many
+	int32_t predicted = m_position + (((int32_t)m_velocity * m_interval) >> (8 - POSITION_SHIFT));
+	int32_t residual = measured - predicted;
+	if (residual > MAX_RESIDUAL || residual < -MAX_RESIDUAL)
+	{
+		m_position = measured;
+		m_velocity = 0;
+		return;
+	}
+
+	m_position = predicted + (residual >> ALPHA_SHIFT);
+	int16_t velocity = m_velocity + (int16_t)(residual << (8 - POSITION_SHIFT - BETA_SHIFT)) / (int16_t)m_interval;
+	m_velocity = velocity > MAX_VELOCITY ? MAX_VELOCITY : velocity < -MAX_VELOCITY ? -MAX_VELOCITY : velocity;
+}
+
+uint16_t MotionTracker::predict(uint8_t ahead) const
+{
+	int32_t position = (m_position + (((int32_t)m_velocity * ahead) >> (8 - POSITION_SHIFT)) + (1 << (POSITION_SHIFT - 1))) >> POSITION_SHIFT;
+	return position < 1 ? 1 : position > 0xFFFE ? 0xFFFE : (uint16_t)position;
+}
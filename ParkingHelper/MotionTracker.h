@@ -0,0 +1,55 @@
+/*
+* MotionTracker.h
+*
+* Created: 10/16/2026 8:41:05 PM
+*/
+
+
+#ifndef __MOTIONTRACKER_H__
+#define __MOTIONTRACKER_H__
+
+#include <stdint.h>
+
+// Alpha-beta tracker over timestamped distance readings, estimating position and closing speed so that the display can
+// show where the vehicle will be rather than where it was. Integer-only: the position is kept in 1/16 echo ticks and the
+// velocity in 1/256 echo ticks per scheduler tick, with alpha = 1/2 and beta = 1/8 as shifts. An update costs one
+// 16-bit divide.
+//
+// A reading that jumps further than any vehicle could have moved, or one after a long gap, restarts the track at that
+// reading with zero velocity.
+class MotionTracker
+{
+//variables
+public:
+protected:
+private:
+	int32_t m_position;			// 1/16 echo ticks
+	int16_t m_velocity;			// 1/256 echo ticks per scheduler tick, positive moving away
+	uint32_t m_time;			// Scheduler time of the last reading
+	uint8_t m_interval;			// Scheduler ticks between the last two readings
+	bool m_tracking;
+
+//functions
+public:
+	MotionTracker();
+	~MotionTracker();
+
+	// Forgets the track, e.g. when the readings stop being distances
+	void reset();
+
+	// Adds a reading, in echo ticks, taken at the given scheduler time
+	void update(uint16_t distance, uint32_t time);
+
+	// Returns the position, in echo ticks, the given number of scheduler ticks after the last reading. Never zero.
+	uint16_t predict(uint8_t ahead) const;
+
+	uint8_t interval() const { return m_interval; }
+
+protected:
+private:
+	MotionTracker( const MotionTracker &c );
+	MotionTracker& operator=( const MotionTracker &c );
+
+}; //MotionTracker
+
+#endif //__MOTIONTRACKER_H__
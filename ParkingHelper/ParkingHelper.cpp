@@ -6,83 +6,170 @@
  */ 
 
 #include <stddef.h>
-#include <avr/io.h>
-#include <util/delay.h>
-#include <avr/sleep.h>
-#include <avr/interrupt.h>
-#include <util/atomic.h>
-#include <avr/eeprom.h>
+#include "Hal.h"
 #include "LPD8806tiny.h"
 #include "LedSequencer.h"
 #include "DistanceSensor.h"
-
-const uint8_t MSECS_PER_SLOW_INT = 1;
+#include "EventQueue.h"
+#include "Scheduler.h"
+#include "SettingsStore.h"
+#include "EepromLayout.h"
+#include "MotionTracker.h"
+#include "Instrumentation.h"
+#include "TraceRecorder.h"
+
+const uint8_t NUM_LEDS = 4;
 const uint8_t SEQUENCER_TICK_DIVISOR = 10;
-const float DEFAULT_STOP_DISTANCE = 15.0f;
-const float DANGER_CLOSE_DELTA = 3.0f;
-const float CAUTION_DISTANCE = 150.0f;
-const uint32_t MOTIONLESS_TICKS_TO_IDLE = 120000;
-const float MOTION_THRESHOLD_CM = 2;
-const uint16_t IDLE_CAPTURE_INTERVAL = 10000;
-const uint16_t PROGRAM_COUNTDOWN_SEGMENT_TICKS = 10000;
+// Distances are in echo ticks (see DistanceSensor.h)
+const uint16_t DEFAULT_STOP_DISTANCE = MM_TO_ECHO_TICKS(150);
+const uint16_t DANGER_CLOSE_DELTA = MM_TO_ECHO_TICKS(30);
+const uint16_t CAUTION_DISTANCE = MM_TO_ECHO_TICKS(1500);
+const uint16_t ACTIVE_RANGE_MARGIN = MM_TO_ECHO_TICKS(200);	// Readings this far past every band limit all look the same
+// Delays are in scheduler ticks (see Scheduler.h)
+const uint32_t MOTIONLESS_TICKS_TO_IDLE = MSECS_TO_SCHEDULER_TICKS(120000);
+const uint32_t BUTTON_POLL_TICKS = MSECS_TO_SCHEDULER_TICKS(50);
+const uint16_t MOTION_THRESHOLD = MM_TO_ECHO_TICKS(20);
+const uint8_t IDLE_WAKEUPS_PER_CAPTURE = 5;		// Watchdog wakeups (2s apart) between readings while dormant in IDLE
+const uint32_t PROGRAM_COUNTDOWN_SEGMENT_TICKS = MSECS_TO_SCHEDULER_TICKS(10000);
 const uint16_t PROGRAM_COUNTDOWN_SEGMENTS = 5;
-const uint32_t EE_SIGNATURE = 0x4d4b4d43;
-
-uint32_t EEMEM ee_signature;
-float EEMEM ee_stopDistance;
+const uint8_t CONFIRM_PROGRAM_PLAYS = 5;
+const uint8_t CONFIRM_TRACE_PLAYS = 3;
+const uint32_t EE_SIGNATURE = 0x4d4b4d44;			// ee_layout.stopDistance holds millimetres (uint16_t)
+const uint32_t EE_SIGNATURE_FLOAT_CM = 0x4d4b4d43;	// Original layout: ee_layout.stopDistance holds centimetres (float)
 
 volatile uint32_t ticks = 0;
 
-Color colorTable[] = { Color::Black, Color::Red, Color::Green, Color::Blue, Color::Yellow };
-enum ColorOffsets { Color_Black = 0, Color_Red, Color_Green, Color_Blue, Color_Yellow };
-
-//  Color patterns
-uint8_t allBlack[] = { Color_Black, Color_Black, Color_Black, Color_Black};
-uint8_t allYellow[] = { Color_Yellow, Color_Yellow, Color_Yellow, Color_Yellow };
-uint8_t allRed[] = { Color_Red, Color_Red, Color_Red, Color_Red};
-uint8_t oneGreen[] = { Color_Green, Color_Black, Color_Black, Color_Black};
-uint8_t twoGreen[] = { Color_Green, Color_Green, Color_Black, Color_Black};
-uint8_t threeGreen[] = { Color_Green, Color_Green, Color_Green, Color_Black};
-uint8_t allGreen[] = { Color_Green, Color_Green, Color_Green, Color_Green};
-uint8_t allBlue[] = { Color_Blue, Color_Blue, Color_Blue, Color_Blue};
-uint8_t oneYellow[] = { Color_Yellow, Color_Black, Color_Black, Color_Black};
-uint8_t twoYellow[] = { Color_Yellow, Color_Yellow, Color_Black, Color_Black};
-uint8_t threeYellow[] = { Color_Yellow, Color_Yellow, Color_Yellow, Color_Black};
-	
-uint8_t allBlueRedOne[] = { Color_Red, Color_Blue, Color_Blue, Color_Blue};
-uint8_t allBlueRedTwo[] = { Color_Blue, Color_Red, Color_Blue, Color_Blue};
-uint8_t allBlueRedThree[] = { Color_Blue, Color_Blue, Color_Red, Color_Blue};
-uint8_t allBlueRedFour[] = { Color_Blue, Color_Blue, Color_Blue, Color_Red};
-
-Segment seqAllBlack[] = { { allBlack, 255} };
-Segment seqCautionOne[] =  { { oneYellow, 50},  { allBlack, 50} };
-Segment seqCautionTwo[] =  { { twoYellow, 50},  { oneYellow, 50} };
-Segment seqCautionThree[] =  { { threeYellow, 50},  { twoYellow, 50} };
-Segment seqCautionFour[] =  { { allYellow, 50},  { threeYellow, 50} };
-Segment seqWelcomeAboard[] = { {oneGreen, 25}, {twoGreen, 25}, {threeGreen, 25}, {allGreen, 50} };
-Segment seqStop[] = { {allRed, 255} };
-Segment seqDangerClose[] = { {allRed, 10}, {allBlack, 10} };
-	
-Segment seqProgramCountdown[] = { {allBlueRedOne, 10}, {allBlueRedTwo, 10}, {allBlueRedThree, 10}, {allBlueRedFour, 10}, {allBlueRedFour, 10}, {allBlueRedThree, 10}, {allBlueRedTwo, 10}, {allBlueRedOne, 10} };
-Segment seqConfirmProgram[] = { { allBlue, 20}, { allRed , 10} };
+// Events posted by interrupt handlers for main() to handle
+enum Event
+{
+	EVENT_TIMER,			// A scheduler deadline is due
+	EVENT_CAPTURE_DONE,		// The distance sensor's echo pulse has ended
+	EVENT_WATCHDOG			// The watchdog period has elapsed (only enabled while dormant)
+};
+
+EventQueue<8> g_events;
+Scheduler g_scheduler;
+
+// Color codes, indexed by the color offsets that patterns are made of
+const uint32_t colorTable[] PROGMEM = { Color::Black, Color::Red, Color::Green, Color::Blue, Color::Yellow };
+enum ColorOffsets { Color_Black = 0, Color_Red, Color_Green, Color_Blue, Color_Yellow, NUM_COLORS };
+
+// Color patterns, generated at compile time for NUM_LEDS:
+//   solidPatterns[c]	every LED in color c
+//   yellowBars[n]		the first n LEDs yellow, the rest off
+//   greenBars[n]		the first n LEDs green, the rest off
+//   redDots[n]			LED n red, the rest blue
+static constexpr uint8_t solid(uint8_t color, uint8_t /*led*/) { return color; }
+static constexpr uint8_t yellowBar(uint8_t lit, uint8_t led) { return led < lit ? Color_Yellow : Color_Black; }
+static constexpr uint8_t greenBar(uint8_t lit, uint8_t led) { return led < lit ? Color_Green : Color_Black; }
+static constexpr uint8_t redDot(uint8_t position, uint8_t led) { return led == position ? Color_Red : Color_Blue; }
+
+const PatternTable<NUM_LEDS, NUM_COLORS> solidPatterns PROGMEM = generatePatterns<NUM_LEDS, NUM_COLORS, solid>();
+const PatternTable<NUM_LEDS, NUM_LEDS + 1> yellowBars PROGMEM = generatePatterns<NUM_LEDS, NUM_LEDS + 1, yellowBar>();
+const PatternTable<NUM_LEDS, NUM_LEDS + 1> greenBars PROGMEM = generatePatterns<NUM_LEDS, NUM_LEDS + 1, greenBar>();
+const PatternTable<NUM_LEDS, NUM_LEDS> redDots PROGMEM = generatePatterns<NUM_LEDS, NUM_LEDS, redDot>();
+
+#define SOLID(color) (solidPatterns.patterns[color].colors)
+
+const Segment seqAllBlack[] PROGMEM = { {SOLID(Color_Black), 255, false} };
+const Segment seqStop[] PROGMEM = { {SOLID(Color_Red), 255, false} };
+const Segment seqDangerClose[] PROGMEM = { {SOLID(Color_Red), 10, false}, {SOLID(Color_Black), 10, false} };
+const Segment seqConfirmProgram[] PROGMEM = { {SOLID(Color_Blue), 20, false}, {SOLID(Color_Red), 10, false} };
+const Segment seqConfirmTrace[] PROGMEM = { {SOLID(Color_Green), 20, false}, {SOLID(Color_Black), 10, false} };
+
+// Caution sequences, nearest band first. Each blinks between two adjacent yellow bars, from all LEDs down to one.
+const uint8_t NUM_CAUTION_BANDS = NUM_LEDS;
+const uint8_t CAUTION_BAND_SEGMENTS = 2;
+static constexpr Segment cautionSegment(uint8_t segment)
+{
+	return Segment{ yellowBars.patterns[NUM_LEDS - segment / CAUTION_BAND_SEGMENTS - segment % CAUTION_BAND_SEGMENTS].colors, 50, false };
+}
+const uint8_t NUM_CAUTION_SEGMENTS = NUM_CAUTION_BANDS * CAUTION_BAND_SEGMENTS;
+const SegmentTable<NUM_CAUTION_SEGMENTS> seqCaution PROGMEM = generateSegments<NUM_CAUTION_SEGMENTS, cautionSegment>();
+
+// Green bar filling up, holding for longer when full
+static constexpr Segment welcomeAboardSegment(uint8_t segment)
+{
+	return Segment{ greenBars.patterns[segment + 1].colors, (uint8_t)(segment == NUM_LEDS - 1 ? 50 : 25), false };
+}
+const SegmentTable<NUM_LEDS> seqWelcomeAboard PROGMEM = generateSegments<NUM_LEDS, welcomeAboardSegment>();
+
+// Red dot moving along the strip and back
+static constexpr Segment programCountdownSegment(uint8_t segment)
+{
+	return Segment{ redDots.patterns[segment < NUM_LEDS ? segment : 2 * NUM_LEDS - 1 - segment].colors, 10, false };
+}
+const SegmentTable<2 * NUM_LEDS> seqProgramCountdown PROGMEM = generateSegments<2 * NUM_LEDS, programCountdownSegment>();
+
+// What to show for a band of distances
+struct BandSequence
+{
+	const Segment* segments;
+	uint8_t numSegments;
+	bool autoRepeat;
+};
+
+// Distance bands, nearest first: danger close, stop, the caution bands, then welcome aboard for everything beyond. The
+// range between the stop distance and CAUTION_DISTANCE is split evenly between the caution bands.
+const uint8_t BAND_DANGER_CLOSE = 0;
+const uint8_t BAND_STOP = 1;
+const uint8_t BAND_FIRST_CAUTION = 2;
+const uint8_t BAND_WELCOME_ABOARD = BAND_FIRST_CAUTION + NUM_CAUTION_BANDS;
+const uint8_t NUM_DISTANCE_BANDS = BAND_WELCOME_ABOARD + 1;
+
+typedef LPD8806Fixed<NUM_LEDS, PB0 /* data */, PB2 /* clock */> LedStrip;
+
+// The watchdog, in interrupt mode, paces readings while dormant. It runs from its own oscillator, so it keeps counting
+// in power-down. Its configuration can only be changed within four cycles of setting WDCE and WDE.
+static void startWatchdog()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		Watchdog::control() = _BV(WDCE) | _BV(WDE);
+		Watchdog::control() = _BV(WDIE) | _BV(WDP2) | _BV(WDP1) | _BV(WDP0);	// Interrupt every 2s, no reset
+	}
+}
+
+static void stopWatchdog()
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		Watchdog::control() = _BV(WDCE) | _BV(WDE);
+		Watchdog::control() = 0;
+	}
+}
 
 class ParkingHelper
 {
 public:
-	ParkingHelper(uint8_t numLeds);
+	ParkingHelper();
 	~ParkingHelper();
 	
-	void tick();
+	void begin();
+	void timersDue();
+	void captureComplete();
+	void watchdogTimeout();
+	void poweredUp();
+	bool isDormant();
+	bool isSaving();
 private:
 	void setAllLedsToColor(const Color& color);
-	void setPatternForDistance(float distance);
-	void doIdle();
-	void doActive();
-	void doProgram();
+	void setPatternForDistance(uint16_t distance);
+	void buildDistanceBands();
+	BandSequence bandSequence(uint8_t band);
+	void handleCapture();
+	void handleIdleCapture();
+	void handleActiveCapture();
 	void goIdle();
 	void goActive();
 	void goProgram();
+	void goDormant();
+	void leaveDormant();
+	void freezeTrace();
 	bool isButtonPressed();
+	static void pollButton(void* context);
+	static void motionTimeout(void* context);
+	static void programSegmentElapsed(void* context);
 	void loadStopDistance();
 	void saveStopDistance();
 	
@@ -94,39 +181,62 @@ private:
 	};
 	
 	uint8_t m_state;
-	LPD8806 m_leds;
-	LedSequencer m_sequencer;
-	DistanceSensor m_distanceSensor;
-	uint32_t m_millis;
-	uint32_t m_ticksSinceMotion;
-	float m_lastDistance;
-	uint16_t m_idleCaptureTicks;
-	uint16_t m_programCountdown;
+	SettingsStore m_settings;
+	LedStrip m_leds;
+	LedSequencer<LedStrip> m_sequencer;
+	DistanceSensorFixed<> m_distanceSensor;
+	uint8_t m_buttonTimer;
+	uint8_t m_motionTimer;		// Runs out once there has been no motion for MOTIONLESS_TICKS_TO_IDLE
+	uint8_t m_programTimer;
+	uint16_t m_lastDistance;
+	MotionTracker m_tracker;
+	uint8_t m_idleWakeups;
+	bool m_dormant;				// In IDLE with the scheduler stopped, waiting in power-down for the watchdog or the button
+	bool m_buttonReleased;		// Since the press that started PROGRAM
 	uint16_t m_programSegment;
-	float m_stopDistance;
+	uint16_t m_stopDistance;
+	uint16_t m_bandLimits[NUM_DISTANCE_BANDS];	// Readings below m_bandLimits[i] (and not below the previous limit) are in band i
+	uint16_t m_activeRange;		// The sensor's maximum range in ACTIVE
 };
 
-ParkingHelper g_parkingHelper(4);
+ParkingHelper g_parkingHelper;
+
+// Called by the distance sensor's pin change interrupt handler
+static void postCaptureDone()
+{
+	g_events.push(EVENT_CAPTURE_DONE);
+}
+
+// Called by the scheduler's Timer1 interrupt handlers
+static void postTimersDue()
+{
+	g_events.push(EVENT_TIMER);
+}
 
-ParkingHelper::ParkingHelper(uint8_t numLeds)
+ParkingHelper::ParkingHelper()
 	: m_state(ACTIVE), 
-	m_leds(numLeds, PB0 /* data */, PB2 /* clock */),
-	m_sequencer(&m_leds, colorTable, NELEMS(colorTable), SEQUENCER_TICK_DIVISOR),
-	m_distanceSensor(PB1),
-	m_millis(0),
-	m_ticksSinceMotion(0),
-	m_lastDistance(0.0f),
-	m_idleCaptureTicks(0),
-	m_programCountdown(0),
+	m_sequencer(&m_leds, colorTable, NELEMS(colorTable), SEQUENCER_TICK_DIVISOR, &g_scheduler),
+	m_distanceSensor(PB1, &g_scheduler),
+	m_lastDistance(0),
+	m_idleWakeups(0),
+	m_dormant(false),
+	m_buttonReleased(false),
 	m_programSegment(0),
 	m_stopDistance(DEFAULT_STOP_DISTANCE)
 {
 	m_leds.begin();	
+	m_distanceSensor.setFilterEnabled(true);
+	m_distanceSensor.setEchoCompleteHandler(postCaptureDone);
+	m_buttonTimer = g_scheduler.addTimer(pollButton, this);
+	m_motionTimer = g_scheduler.addTimer(motionTimeout, this);
+	m_programTimer = g_scheduler.addTimer(programSegmentElapsed, this);
+	g_scheduler.setDueHandler(postTimersDue);
 	setAllLedsToColor(Color::Black);
 
-	PORTB |= _BV(PB3) | _BV(PB4); // Enable pull-up resistor on inputs PB3 (switch) and PB4 (unused pin)	
+	PortB::port() |= _BV(PB3) | _BV(PB4); // Enable pull-up resistor on inputs PB3 (switch) and PB4 (unused pin)	
 
 	loadStopDistance();	// Load stop distance from EEPROM	
+	buildDistanceBands();
 }
 
 ParkingHelper::~ParkingHelper()
@@ -134,12 +244,41 @@ ParkingHelper::~ParkingHelper()
 	
 }
 
+// Converts the bits of a non-negative IEEE 754 single precision centimetre value to millimetres, without linking in
+// the soft-float library. Only needed to migrate settings saved by older firmware.
+static uint16_t floatBitsCmToMm(uint32_t bits)
+{
+	uint8_t exponent = (uint8_t)(bits >> 23);	// Sign bit falls off the top; negative values have no valid exponent here
+	if ((bits & 0x80000000UL) || exponent < 127 || exponent > 127 + 11)
+	{
+		return 0;	// Negative, below 1cm, or beyond 40m: not a usable stop distance
+	}
+	uint32_t mantissa = (bits & 0x007FFFFFUL) | 0x00800000UL;	// 1.23 fixed point with the implicit leading one
+	uint8_t shift = 23 - (exponent - 127);
+	return (uint16_t)((mantissa * 10 + (1UL << (shift - 1))) >> shift);
+}
+
 void ParkingHelper::loadStopDistance()
 {
-	uint32_t signature = eeprom_read_dword(&ee_signature);
+	Settings settings;
+	if (m_settings.load(settings))
+	{
+		m_stopDistance = MM_TO_ECHO_TICKS(settings.stopDistanceMm);
+		return;
+	}
+	
+	// Nothing in the settings ring yet; migrate whatever older firmware left in the fixed cells
+	uint32_t signature = Eeprom::readDword(&ee_layout.signature);
+	uint32_t stored = Eeprom::readDword(&ee_layout.stopDistance);
 	if (signature == EE_SIGNATURE)
 	{
-		m_stopDistance = eeprom_read_float(&ee_stopDistance);			
+		m_stopDistance = MM_TO_ECHO_TICKS((uint16_t)stored);
+		saveStopDistance();
+	}
+	else if (signature == EE_SIGNATURE_FLOAT_CM && floatBitsCmToMm(stored) != 0)
+	{
+		m_stopDistance = MM_TO_ECHO_TICKS(floatBitsCmToMm(stored));
+		saveStopDistance();
 	}
 	else
 	{
@@ -147,40 +286,99 @@ void ParkingHelper::loadStopDistance()
 	}
 }
 
+// Returns straight away; the settings are written in the background
 void ParkingHelper::saveStopDistance()
 {
-	eeprom_write_float(&ee_stopDistance, m_stopDistance);
-	eeprom_write_dword(&ee_signature, EE_SIGNATURE);
+	Settings settings = { ECHO_TICKS_TO_MM(m_stopDistance) };
+	m_settings.save(settings);
 }
 
 bool ParkingHelper::isButtonPressed()
 {
-	return !(PINB & _BV(PB3));
+	return !(PortB::pin() & _BV(PB3));
 }
 
-void ParkingHelper::tick()
+// Starts the scheduler and the first reading. Called by main() once the hardware is configured.
+void ParkingHelper::begin()
 {
-	++m_millis;
+	Instrumentation::begin(&g_scheduler);
+	g_scheduler.start();
+	g_scheduler.startPeriodic(m_buttonTimer, BUTTON_POLL_TICKS);
+	goActive();
+}
 
-	m_distanceSensor.tick();
-	
-	// TODO: Replace c-style switch statement with implementation of State pattern
+// Handles an EVENT_TIMER
+void ParkingHelper::timersDue()
+{
+	g_scheduler.runDue();
+	if (m_distanceSensor.hasCapture())
+	{
+		handleCapture();	// A timeout, or an echo that ended before its event was handled
+	}
+}
+
+// The button shares PCINT0 with the echo, so it is polled rather than interrupting (except while dormant). With the
+// trace recorder compiled in, pressing it again during the program countdown freezes the trace instead.
+void ParkingHelper::pollButton(void* context)
+{
+	ParkingHelper* helper = (ParkingHelper*)context;
+	if ((helper->m_state == IDLE || helper->m_state == ACTIVE) && !helper->m_sequencer.isPlaying() && helper->isButtonPressed())
+	{
+		helper->goProgram();
+	}
+	else if (TraceRecorder::ENABLED && helper->m_state == PROGRAM)
+	{
+		if (!helper->isButtonPressed())
+		{
+			helper->m_buttonReleased = true;
+		}
+		else if (helper->m_buttonReleased && !helper->isSaving())
+		{
+			helper->freezeTrace();
+		}
+	}
+}
+
+void ParkingHelper::motionTimeout(void* context)
+{
+	ParkingHelper* helper = (ParkingHelper*)context;
+	if (helper->m_state == ACTIVE)
+	{
+		helper->goIdle();
+	}
+}
+
+// Handles an EVENT_CAPTURE_DONE, so a reading is acted on as soon as its echo ends rather than when it would time out
+void ParkingHelper::captureComplete()
+{
+	if (m_distanceSensor.completeCapture())
+	{
+		handleCapture();
+	}
+}
+
+void ParkingHelper::handleCapture()
+{
+	uint16_t echo = m_distanceSensor.getRawCapture();
+	uint32_t time = m_distanceSensor.getCaptureTime();
 	switch(m_state)
 	{
 	case IDLE:
-		doIdle();
+		handleIdleCapture();
 		break;
 		
 	case ACTIVE:
-		doActive();
+		handleActiveCapture();
 		break;
 		
 	case PROGRAM:
-		doProgram();
+		m_distanceSensor.startCapture();	// Keep reading; the countdown takes the latest reading when it ends
+		return;								// Not traced, so the trace still holds what led up to the countdown
+		
+	default:
 		break;
 	}
-	
-	m_sequencer.tick();
+	TraceRecorder::record(time, echo, m_state);
 }
 
 void ParkingHelper::goIdle()
@@ -188,119 +386,189 @@ void ParkingHelper::goIdle()
 	// Clear display and leave it cleared
 	m_sequencer.clear();
 	m_sequencer.setTickDivisor(SEQUENCER_TICK_DIVISOR);
-	m_ticksSinceMotion = 0;
-	m_idleCaptureTicks = 0;
+	m_idleWakeups = 0;
+	if (m_state != IDLE)
+	{
+		Instrumentation::count(Instrumentation::STATE_CHANGES);
+	}
 	m_state = IDLE;
+	Instrumentation::sendRecord();	// Scheduler time all but stops from here on
+	m_distanceSensor.setMaxRange(0);	// So that motion anywhere in the sensor's range wakes it
+	if (!m_distanceSensor.isCapturing())
+	{
+		goDormant();	// Otherwise once the reading underway has been handled
+	}
 }
 
 void ParkingHelper::goActive()
 {
+	if (m_state != ACTIVE)
+	{
+		m_distanceSensor.remeasureTemperature();	// It may have been dormant for hours
+		Instrumentation::count(Instrumentation::STATE_CHANGES);
+	}
 	m_sequencer.clear();
 	m_sequencer.setTickDivisor(SEQUENCER_TICK_DIVISOR);
-	m_ticksSinceMotion = 0;
-	m_idleCaptureTicks = 0;
+	g_scheduler.startOneShot(m_motionTimer, MOTIONLESS_TICKS_TO_IDLE);
 	m_state = ACTIVE;
+	m_distanceSensor.setMaxRange(m_activeRange);
+	m_tracker.reset();
+	m_distanceSensor.startCapture();
 }
 
 void ParkingHelper::goProgram()
 {
-	m_programCountdown = PROGRAM_COUNTDOWN_SEGMENT_TICKS;
+	g_scheduler.cancel(m_motionTimer);
+	g_scheduler.startPeriodic(m_programTimer, PROGRAM_COUNTDOWN_SEGMENT_TICKS);
 	m_programSegment = PROGRAM_COUNTDOWN_SEGMENTS;
-	m_sequencer.startSequence(seqProgramCountdown, NELEMS(seqProgramCountdown), true);
+	m_distanceSensor.remeasureTemperature();	// The reading is about to be saved
 	m_sequencer.setTickDivisor(10 * m_programSegment);
+	m_sequencer.startSequence(seqProgramCountdown.segments, NELEMS(seqProgramCountdown.segments), true);
+	Instrumentation::count(Instrumentation::STATE_CHANGES);
 	m_state = PROGRAM;
+	m_buttonReleased = false;
+	m_distanceSensor.setMaxRange(0);	// The stop distance may be set anywhere in the sensor's range
+	m_distanceSensor.startCapture();
 }
 
-void ParkingHelper::doProgram()
+// Called at the end of each segment of the program countdown. The countdown sequence speeds up with each segment.
+void ParkingHelper::programSegmentElapsed(void* context)
 {
-	m_distanceSensor.startCapture();	// Code will ignore request if not ready
+	ParkingHelper* helper = (ParkingHelper*)context;
+	if (--helper->m_programSegment == 0)
+	{
+		// Program the setting
+		g_scheduler.cancel(helper->m_programTimer);
+		helper->m_stopDistance = helper->m_distanceSensor.getCaptureAndClear();
+		helper->saveStopDistance();
+		helper->buildDistanceBands();
+		
+		// Ranging carries on while the confirmation plays, and the distance display takes over once it finishes
+		helper->goActive();
+		helper->m_sequencer.playSequence(seqConfirmProgram, NELEMS(seqConfirmProgram), CONFIRM_PROGRAM_PLAYS);
+		return;
+	}
+	helper->m_sequencer.setTickDivisor(10 * helper->m_programSegment);
+}
 
-	if (--m_programCountdown == 0)
+// Abandons the program countdown, keeping the stop distance, and writes the trace to EEPROM
+void ParkingHelper::freezeTrace()
+{
+	g_scheduler.cancel(m_programTimer);
+	TraceRecorder::freeze();
+	goActive();
+	m_sequencer.playSequence(seqConfirmTrace, NELEMS(seqConfirmTrace), CONFIRM_TRACE_PLAYS);
+}
+
+static inline uint16_t distanceDelta(uint16_t a, uint16_t b)
+{
+	return a > b ? a - b : b - a;
+}
+
+// Stops the scheduler and lets main() power down until the watchdog says the next reading is due, or the button is pressed.
+// Between readings nothing else happens in IDLE, and the device spends nearly all of its life there.
+void ParkingHelper::goDormant()
+{
+	m_distanceSensor.endRecovery();	// The next reading is seconds away
+	g_scheduler.stop();
+	PinChangeInterrupts::mask() |= _BV(PB3);	// The button wakes the CPU from power-down
+	startWatchdog();
+	m_dormant = true;
+}
+
+void ParkingHelper::leaveDormant()
+{
+	stopWatchdog();
+	PinChangeInterrupts::mask() &= ~_BV(PB3);
+	g_scheduler.start();
+	m_dormant = false;
+}
+
+bool ParkingHelper::isDormant()
+{
+	return m_dormant;
+}
+
+bool ParkingHelper::isSaving()
+{
+	return m_settings.isBusy();
+}
+
+// Handles an EVENT_WATCHDOG. Every IDLE_WAKEUPS_PER_CAPTURE wakeups, restarts the scheduler and takes a reading;
+// handleIdleCapture() goes dormant again once it has been handled.
+void ParkingHelper::watchdogTimeout()
+{
+	if (!m_dormant || ++m_idleWakeups < IDLE_WAKEUPS_PER_CAPTURE)
 	{
-		if (--m_programSegment == 0)
-		{
-			// Program the setting
-			m_sequencer.setTickDivisor(SEQUENCER_TICK_DIVISOR);
-			for (int i = 0; i < 5; i++)
-			{
-				m_sequencer.playSequence(seqConfirmProgram, NELEMS(seqConfirmProgram), 1);
-				m_stopDistance = m_distanceSensor.getCaptureAndClear();
-				saveStopDistance();
-			}
-			goActive();
-			return;
-		}
-		m_programCountdown = PROGRAM_COUNTDOWN_SEGMENT_TICKS;
-		m_sequencer.setTickDivisor(10 * m_programSegment);
+		return;
 	}
+	m_idleWakeups = 0;
+	leaveDormant();
+	m_distanceSensor.startCapture();
 }
 
-void ParkingHelper::doIdle()
+// Called by main() after each sleep while dormant. The watchdog posts an event, but a press of the button only wakes the
+// CPU, so check for one here.
+void ParkingHelper::poweredUp()
 {
-	// In idle mode we capture distance readings every few seconds and do not display anything
-	// If we detect motion, we return to active mode
-	
-	if (isButtonPressed())
+	if (m_dormant && isButtonPressed())
 	{
+		leaveDormant();
 		goProgram();
 	}
-	
-	if (m_distanceSensor.hasCapture())
+}
+
+void ParkingHelper::handleIdleCapture()
+{
+	uint16_t raw = m_distanceSensor.getRawCapture();
+	uint16_t distance = m_distanceSensor.getCaptureAndClear();
+	uint16_t delta = distanceDelta(m_lastDistance, distance);
+	if (m_lastDistance == DistanceSensor::BEYOND_RANGE && distance >= m_activeRange)
 	{
-		float distance = m_distanceSensor.getCaptureAndClear();
-		float delta = m_lastDistance > distance ? m_lastDistance - distance : distance - m_lastDistance;
-		m_lastDistance = distance;
-		if (delta > MOTION_THRESHOLD_CM)
-		{
-			goActive();
-			return;
-		}
+		delta = 0;	// The last reading in ACTIVE couldn't see past its range, and nothing has come within it
 	}
-	
-	if (m_idleCaptureTicks >= IDLE_CAPTURE_INTERVAL)
+	m_lastDistance = distance;
+	if (delta > MOTION_THRESHOLD)
 	{
-		if (m_distanceSensor.isReadyForCapture())
-		{			
-			m_idleCaptureTicks = 0;
-			m_distanceSensor.startCapture();
-		}
+		Instrumentation::count(Instrumentation::MOTION_WAKEUPS);
+		goActive();
+		return;
 	}
-	else
+	if (distanceDelta(m_lastDistance, raw) > MOTION_THRESHOLD)
 	{
-		++m_idleCaptureTicks;
+		// Either a spurious echo or real motion that the filter hasn't passed yet. Confirm with another reading as
+		// soon as the sensor is ready, rather than waiting out the idle interval.
+		m_distanceSensor.startCapture();
+		return;
 	}
+	goDormant();
 }
 
-void ParkingHelper::doActive()
+void ParkingHelper::handleActiveCapture()
 {
-	// In active mode we capture and display distance readings as fast as the sensor can go
-	
-	if (isButtonPressed())
+	uint16_t distance = m_distanceSensor.getCaptureAndClear();	
+	uint16_t delta = distanceDelta(m_lastDistance, distance);
+	m_lastDistance = distance;
+	if (delta > MOTION_THRESHOLD)
 	{
-		goProgram();
+		g_scheduler.startOneShot(m_motionTimer, MOTIONLESS_TICKS_TO_IDLE);
 	}
 	
-	++m_ticksSinceMotion;
-	
-	if (m_distanceSensor.hasCapture())
+	// Each pattern stays up until the next reading replaces it, so show where the vehicle will be by then. Otherwise the
+	// display trails an approaching vehicle by a whole reading.
+	if (distance == 0 || distance == DistanceSensor::BEYOND_RANGE)
 	{
-		float distance = m_distanceSensor.getCaptureAndClear();	
-		float delta = m_lastDistance > distance ? m_lastDistance - distance : distance - m_lastDistance;
-		m_lastDistance = distance;
-		if (delta > MOTION_THRESHOLD_CM)
-		{
-			m_ticksSinceMotion = 0;
-		}
-		else if (m_ticksSinceMotion >= MOTIONLESS_TICKS_TO_IDLE)
-		{
-			goIdle();
-			return;
-		}
-		
+		m_tracker.reset();
 		setPatternForDistance(distance);
 	}
-
-	m_distanceSensor.startCapture();	// Code will ignore request if not ready
+	else
+	{
+		m_tracker.update(distance, m_distanceSensor.getCaptureTime());
+		setPatternForDistance(m_tracker.predict(m_tracker.interval()));
+	}
+	
+	// In active mode we capture and display distance readings as fast as the sensor can go
+	m_distanceSensor.startCapture();
 }
 
 void ParkingHelper::setAllLedsToColor(const Color& color)
@@ -309,91 +577,130 @@ void ParkingHelper::setAllLedsToColor(const Color& color)
 	{
 		m_leds.setPixelColor(i, color);
 	}
+	Instrumentation::count(Instrumentation::SHOWS);
 	m_leds.show();
 }
 
-void ParkingHelper::setPatternForDistance(float distance)
+// Computes the band limits for the current stop distance. Called only when the stop distance changes, so that
+// classifying a reading needs nothing but comparisons.
+void ParkingHelper::buildDistanceBands()
 {
-	if (distance == 0)
+	m_bandLimits[BAND_DANGER_CLOSE] = m_stopDistance > DANGER_CLOSE_DELTA ? m_stopDistance - DANGER_CLOSE_DELTA : 0;
+	m_bandLimits[BAND_STOP] = m_stopDistance;
+	
+	// Split the caution range evenly, with the nearest band absorbing the remainder. If the stop distance is at or beyond
+	// CAUTION_DISTANCE the caution bands are all empty, ending at the stop distance, so that anything past the stop band
+	// (a reading of exactly the stop distance included) is welcome aboard.
+	uint16_t span = CAUTION_DISTANCE > m_stopDistance ? CAUTION_DISTANCE - m_stopDistance : 0;
+	uint16_t width = span / NUM_CAUTION_BANDS;
+	uint16_t limit = span ? m_stopDistance + span + 1 : m_stopDistance;
+	for (uint8_t i = BAND_WELCOME_ABOARD - 1; i >= BAND_FIRST_CAUTION; --i)
 	{
-		// No reading / timeout
-		m_sequencer.startSequenceIfDifferent(seqAllBlack, NELEMS(seqAllBlack), false);
+		m_bandLimits[i] = limit;
+		limit -= width;
 	}
-	else if (distance < m_stopDistance - DANGER_CLOSE_DELTA)
+	
+	m_bandLimits[BAND_WELCOME_ABOARD] = 0xFFFF;
+	m_activeRange = (m_stopDistance > CAUTION_DISTANCE ? m_stopDistance : CAUTION_DISTANCE) + ACTIVE_RANGE_MARGIN;
+}
+
+BandSequence ParkingHelper::bandSequence(uint8_t band)
+{
+	if (band == BAND_DANGER_CLOSE)
 	{
-		m_sequencer.startSequenceIfDifferent(seqDangerClose, NELEMS(seqDangerClose), true);
+		return BandSequence{ seqDangerClose, NELEMS(seqDangerClose), true };
 	}
-	else if (distance < m_stopDistance)
+	if (band == BAND_STOP)
 	{
-		m_sequencer.startSequenceIfDifferent(seqStop, NELEMS(seqStop), false);	
+		return BandSequence{ seqStop, NELEMS(seqStop), false };
 	}
-	else if (distance > CAUTION_DISTANCE)
+	if (band == BAND_WELCOME_ABOARD)
 	{
-		m_sequencer.startSequenceIfDifferent(seqWelcomeAboard, NELEMS(seqWelcomeAboard), true);
+		return BandSequence{ seqWelcomeAboard.segments, NELEMS(seqWelcomeAboard.segments), true };
 	}
-	else
-	{
-		float quarter = (CAUTION_DISTANCE - m_stopDistance) / 4.0f;
-		float d1 = CAUTION_DISTANCE - quarter;
-		float d2 = d1 - quarter;
-		float d3 = d2 - quarter;
+	return BandSequence{ &seqCaution.segments[(band - BAND_FIRST_CAUTION) * CAUTION_BAND_SEGMENTS], CAUTION_BAND_SEGMENTS, true };
+}
 
-		if (distance > d1)
-		{
-			m_sequencer.startSequenceIfDifferent(seqCautionOne, NELEMS(seqCautionOne), true);
-		}
-		else if (distance > d2)
-		{
-			m_sequencer.startSequenceIfDifferent(seqCautionTwo, NELEMS(seqCautionTwo), true);
-		}
-		else if (distance > d3)
-		{
-			m_sequencer.startSequenceIfDifferent(seqCautionThree, NELEMS(seqCautionThree), true);
-		}
-		else
-		{
-			m_sequencer.startSequenceIfDifferent(seqCautionFour, NELEMS(seqCautionFour), true);
-		}
+void ParkingHelper::setPatternForDistance(uint16_t distance)
+{
+	if (distance == 0)
+	{
+		// No reading / timeout
+		m_sequencer.startSequenceIfDifferent(seqAllBlack, NELEMS(seqAllBlack), false);
+		return;
+	}
+	
+	uint8_t band = 0;
+	while (band < BAND_WELCOME_ABOARD && distance >= m_bandLimits[band])
+	{
+		++band;
 	}
+	
+	BandSequence sequence = bandSequence(band);
+	m_sequencer.startSequenceIfDifferent(sequence.segments, sequence.numSegments, sequence.autoRepeat);
 }
 
 int main(void)
 {
-	// Configure Timer1 for 1 ms interrupts
-	TCCR1 |= _BV(CTC1) | _BV(CS13);	// CTC mode, pre-scaler -> CPU clock / 128
-	OCR1C = (F_CPU / 128UL / 1000UL) * MSECS_PER_SLOW_INT - 1; // Clear counter at 125
-	OCR1A = OCR1C;	// On the ATTiny, the OCR1A or OCR1B must be used to generate the actual interrupt
-	TIMSK |= _BV(OCIE1A); // Enable output match compare interrupt	
+	// The analog comparator is unused, and would otherwise stay powered in every sleep mode
+	AnalogComparator::control() |= _BV(ACD);
 	
 	// Enable interrupts
 	sei();
-
 	
+	g_parkingHelper.begin();
+
+	// All application work happens here, outside of interrupt context. Interrupt handlers only post events, so they stay
+	// short and never nest.
 	while(true)
 	{
-		set_sleep_mode(SLEEP_MODE_IDLE);
+		uint8_t event;
+		while (g_events.pop(event))
+		{
+			uint8_t dispatchStart = Instrumentation::startDispatch();
+			switch(event)
+			{
+			case EVENT_TIMER:
+				g_parkingHelper.timersDue();
+				break;
+				
+			case EVENT_CAPTURE_DONE:
+				g_parkingHelper.captureComplete();
+				break;
+				
+			case EVENT_WATCHDOG:
+				g_parkingHelper.watchdogTimeout();
+				break;
+			}
+			Instrumentation::endDispatch(dispatchStart);
+		}
+		
+		// Sleep only if nothing was posted since the queue was drained. Sleep::sleep() re-enables interrupts as it
+		// sleeps, so an event posted after this check still wakes the CPU. While dormant the scheduler is stopped, so
+		// power down; only the watchdog and pin change interrupts can end that. The EEPROM ready interrupt can't, so
+		// settings still being saved hold the CPU in idle sleep, as does an instrumentation record being sent.
 		cli();
-		sleep_enable();
-		sei();
-		sleep_cpu();			
-		// CPU is asleep here			
-		sleep_disable();
+		if (g_events.isEmpty())
+		{
+			if (g_parkingHelper.isDormant())
+			{
+				Sleep::sleep(g_parkingHelper.isSaving() || Instrumentation::isBusy() ? Sleep::IDLE : Sleep::POWER_DOWN);
+				g_parkingHelper.poweredUp();
+			}
+			else
+			{
+				Sleep::sleep(Sleep::IDLE);
+			}
+		}
+		else
+		{
+			sei();
+		}
 	}
 	
 }
 
-// The ISR_NOBLOCK allows nested interrupts so that the hi-res timer (Timer0) handler will not be blocked by this low-res timer code. 
-// This improves accuracy of the distance measurements. We specifically disable the Timer1 interrupt during this routine so that we
-// do not have nested Timer1 interrupts (and the potential for stack overflow).
-ISR(TIMER1_COMPA_vect, ISR_NOBLOCK)
+ISR(WDT_vect)
 {
-	// Disable this interrupt because we do not want to allow THIS interrupt to nest, potentially leading to a stack overflow situation
-	TIMSK &= ~_BV(OCIE1A);
-	
-	g_parkingHelper.tick();
-	
-	// Safely re-enable this interrupt
-	cli();
-	TIMSK |= _BV(OCIE1A);
-	// Global interrupts will be enabled upon execution of the RETI instruction
+	g_events.push(EVENT_WATCHDOG);
 }
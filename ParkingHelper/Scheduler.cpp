@@ -0,0 +1,235 @@
+/*
+* Scheduler.cpp
+*
+* Created: 10/16/2026 4:40:27 PM
+*/
+
+#include "Scheduler.h"
+#include "Instrumentation.h"
+
+volatile static uint32_t g_timeHigh = 0;		// Scheduler time above the low byte, extended from Timer1 overflows
+volatile static uint32_t g_armedWindow = 0;		// Upper bits of the armed deadline, when it is beyond the current overflow
+volatile static bool g_waitingForWindow = false;
+static void (*volatile g_dueHandler)() = 0;
+
+// default constructor
+Scheduler::Scheduler()
+	: m_numTimers(0), m_runningCallbacks(false)
+{
+} //Scheduler
+
+// default destructor
+Scheduler::~Scheduler()
+{
+} //~Scheduler
+
+void Scheduler::setDueHandler(void (*handler)())
+{
+	g_dueHandler = handler;
+}
+
+static void notifyDue()
+{
+	if (g_dueHandler)
+	{
+		g_dueHandler();
+	}
+}
+
+void Scheduler::start()
+{
+	TimerInterrupts::flags() = _BV(OCF1A);	// Discard a compare match left over from before the stop
+	Timer1::control() = _BV(CS13) | _BV(CS12) | _BV(CS11) | _BV(CS10);	// Normal mode, pre-scaler -> CPU clock / 16384
+	TimerInterrupts::mask() |= _BV(TOIE1);
+	rearm();
+}
+
+void Scheduler::stop()
+{
+	TimerInterrupts::mask() &= ~(_BV(TOIE1) | _BV(OCIE1A));
+	Timer1::control() = 0;
+}
+
+uint8_t Scheduler::addTimer(TimerCallback callback, void* context)
+{
+	if (m_numTimers == MAX_TIMERS)
+	{
+		return NO_TIMER;
+	}
+	Timer& timer = m_timers[m_numTimers];
+	timer.callback = callback;
+	timer.context = context;
+	timer.pending = false;
+	return m_numTimers++;
+}
+
+void Scheduler::startOneShot(uint8_t timer, uint32_t ticks)
+{
+	if (timer == NO_TIMER)
+	{
+		return;
+	}
+	startPeriodic(timer, ticks);
+	m_timers[timer].period = 0;
+}
+
+void Scheduler::startPeriodic(uint8_t timer, uint32_t period)
+{
+	if (timer == NO_TIMER)
+	{
+		return;
+	}
+	m_timers[timer].deadline = now() + period;
+	m_timers[timer].period = period;
+	m_timers[timer].pending = true;
+	if (!m_runningCallbacks)
+	{
+		rearm();	// The new deadline may be earlier than the armed one. runDue() re-arms once callbacks are done.
+	}
+}
+
+// Leaves Timer1 armed; at worst it wakes the CPU for a deadline that is no longer pending
+void Scheduler::cancel(uint8_t timer)
+{
+	if (timer != NO_TIMER)
+	{
+		m_timers[timer].pending = false;
+	}
+}
+
+bool Scheduler::isPending(uint8_t timer)
+{
+	return timer != NO_TIMER && m_timers[timer].pending;
+}
+
+// Returns the current time. If Timer1 has overflowed but the overflow handler has not run yet, the low byte has wrapped
+// and the high bits are one behind, so we account for that here.
+uint32_t Scheduler::now()
+{
+	uint32_t high;
+	uint8_t low;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		low = Timer1::counter();
+		high = g_timeHigh;
+		if ((TimerInterrupts::flags() & _BV(TOV1)) && low < 0x80)
+		{
+			++high;
+		}
+	}
+	return (high << 8) | low;
+}
+
+// Returns the index of the pending timer with the earliest deadline, or MAX_TIMERS if none are pending. Deadlines are
+// compared by their distance from now, so that they keep working when the 32-bit count wraps.
+uint8_t Scheduler::earliest()
+{
+	uint32_t time = now();
+	uint8_t next = MAX_TIMERS;
+	for (uint8_t i = 0; i < m_numTimers; ++i)
+	{
+		if (m_timers[i].pending && (next == MAX_TIMERS || (int32_t)(m_timers[i].deadline - time) < (int32_t)(m_timers[next].deadline - time)))
+		{
+			next = i;
+		}
+	}
+	return next;
+}
+
+void Scheduler::runDue()
+{
+	m_runningCallbacks = true;
+	uint8_t next;
+	while ((next = earliest()) != MAX_TIMERS)
+	{
+		Timer& timer = m_timers[next];
+		int32_t early = (int32_t)(timer.deadline - now());
+		if (early > 0 && arm(timer.deadline))
+		{
+			break;	// Nothing else is due yet
+		}
+		if (early < 0)
+		{
+			Instrumentation::count(Instrumentation::LATE_TIMERS);
+		}
+
+		if (timer.period)
+		{
+			timer.deadline += timer.period;	// From the deadline rather than from now, so a late callback doesn't drift
+		}
+		else
+		{
+			timer.pending = false;
+		}
+		timer.callback(timer.context);
+	}
+	m_runningCallbacks = false;
+}
+
+// Programs Timer1 for the earliest pending deadline, or has main() run it now if it is already due
+void Scheduler::rearm()
+{
+	uint8_t next = earliest();
+	if (next != MAX_TIMERS && !arm(m_timers[next].deadline))
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			notifyDue();	// Outside interrupt context, so keep the interrupt handlers from notifying at the same time
+		}
+	}
+}
+
+// Programs the compare register for the deadline. The compare can only match within the current 256 tick overflow
+// period, so a later deadline is left for the overflow handler to enable once its period comes round. Returns false,
+// with nothing armed that can be relied on, if the deadline has already passed.
+bool Scheduler::arm(uint32_t deadline)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uint32_t time = now();
+		TimerInterrupts::mask() &= ~_BV(OCIE1A);
+		Timer1::compareA() = (uint8_t)deadline;
+		if ((deadline >> 8) == (time >> 8))
+		{
+			g_waitingForWindow = false;
+			TimerInterrupts::flags() = _BV(OCF1A);
+			TimerInterrupts::mask() |= _BV(OCIE1A);
+		}
+		else
+		{
+			g_armedWindow = deadline >> 8;
+			g_waitingForWindow = true;
+		}
+	}
+
+	// A compare match between reading the time and clearing the flag above would be lost, so check again
+	return (int32_t)(deadline - now()) > 0;
+}
+
+// This interrupt handler is called on the armed deadline. It notifies the due handler and disarms until the next runDue().
+ISR(TIMER1_COMPA_vect)
+{
+	TimerInterrupts::mask() &= ~_BV(OCIE1A);
+	notifyDue();
+}
+
+// This interrupt handler is called on Timer1 overflow, every 256 ticks (262ms at 16MHz). It extends the count, and
+// enables the compare interrupt if the armed deadline falls within the period just starting.
+ISR(TIMER1_OVF_vect)
+{
+	uint32_t high = g_timeHigh + 1;
+	g_timeHigh = high;
+	if (g_waitingForWindow && g_armedWindow == high)
+	{
+		g_waitingForWindow = false;
+		if (Timer1::compareA() <= Timer1::counter())
+		{
+			notifyDue();	// Matched as (or before) the handler ran
+		}
+		else
+		{
+			TimerInterrupts::flags() = _BV(OCF1A);
+			TimerInterrupts::mask() |= _BV(OCIE1A);
+		}
+	}
+}
@@ -0,0 +1,91 @@
+/*
+* Scheduler.h
+*
+* Created: 10/16/2026 4:40:27 PM
+*/
+
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "Hal.h"
+
+// Scheduler time is counted in Timer1 ticks at F_CPU / SCHEDULER_TIMER_PRESCALER (1.024ms at 16MHz). The conversion is
+// integer-only and exact to the nearest tick for delays up to 268s; with a constant argument it folds at compile time.
+const uint16_t SCHEDULER_TIMER_PRESCALER = 16384;
+
+#define MSECS_TO_SCHEDULER_TICKS(ms) ((uint32_t)(((uint32_t)(ms) * (F_CPU / 1000) + SCHEDULER_TIMER_PRESCALER / 2) / SCHEDULER_TIMER_PRESCALER))
+
+typedef void (*TimerCallback)(void* context);
+
+// Software timers on top of Timer1. Rather than interrupting every millisecond so that each component can count down
+// its own delays, Timer1 free-runs and its compare register is programmed for the earliest pending deadline, so the CPU
+// only wakes when something is due (plus a Timer1 overflow every 256 ticks, which extends the count to 32 bits).
+//
+// Callbacks run from runDue(), in main() rather than interrupt context, and may start or cancel any timer, including
+// their own. There are only a handful of timers, so finding the earliest is a linear scan rather than a heap.
+class Scheduler
+{
+//variables
+public:
+	// ParkingHelper has three timers, and DistanceSensor, LedSequencer and Instrumentation one each, so a build with
+	// INSTRUMENTATION fills the table
+	static const uint8_t MAX_TIMERS = 6;
+	static const uint8_t NO_TIMER = MAX_TIMERS;	// From addTimer() when the table is full
+protected:
+private:
+	struct Timer
+	{
+		TimerCallback callback;
+		void* context;
+		uint32_t deadline;
+		uint32_t period;		// Zero for a one-shot
+		bool pending;
+	};
+
+	Timer m_timers[MAX_TIMERS];
+	uint8_t m_numTimers;
+	bool m_runningCallbacks;
+
+//functions
+public:
+	Scheduler();
+	~Scheduler();
+
+	// Starts and stops Timer1. While stopped (e.g. across a power-down) scheduler time stands still, so pending
+	// deadlines move out by however long it was stopped.
+	void start();
+	void stop();
+
+	// Registers a timer and returns its id, or NO_TIMER if the table is full. Timers are registered once, at
+	// construction, and never removed.
+	uint8_t addTimer(TimerCallback callback, void* context);
+
+	// (Re)starts a timer to fire once, or every period, starting the given number of ticks from now. These ignore
+	// NO_TIMER, which is never pending.
+	void startOneShot(uint8_t timer, uint32_t ticks);
+	void startPeriodic(uint8_t timer, uint32_t period);
+	void cancel(uint8_t timer);
+	bool isPending(uint8_t timer);
+
+	// Sets a function for the Timer1 interrupt handlers to call, in interrupt context, when a deadline is due.
+	// Typically it posts an event so that main() calls runDue().
+	void setDueHandler(void (*handler)());
+
+	// Runs the callbacks of every timer that is due, earliest first, then programs Timer1 for the next deadline
+	void runDue();
+
+	static uint32_t now();
+
+protected:
+private:
+	uint8_t earliest();
+	void rearm();
+	bool arm(uint32_t deadline);
+
+	Scheduler( const Scheduler &c );
+	Scheduler& operator=( const Scheduler &c );
+
+}; //Scheduler
+
+#endif //__SCHEDULER_H__
@@ -0,0 +1,148 @@
+/*
+* SettingsStore.cpp
+*
+* Created: 10/16/2026 6:12:48 PM
+*/
+
+#include "SettingsStore.h"
+#include "EepromLayout.h"
+#include "Crc8.h"
+#include <string.h>
+
+EepromLayout EEMEM ee_layout;
+
+volatile static uint8_t g_record[SettingsStore::RECORD_SIZE];	// Settings record, while it is being written
+static const volatile uint8_t* volatile g_source = g_record;		// Next byte for the interrupt handler to write
+volatile static uint16_t g_writeAddress = 0;					// EEPROM address of the next byte to write
+volatile static uint8_t g_bytesLeft = 0;
+
+// default constructor
+SettingsStore::SettingsStore()
+	: m_nextSlot(0), m_nextSequence(0)
+{
+} //SettingsStore
+
+// default destructor
+SettingsStore::~SettingsStore()
+{
+} //~SettingsStore
+
+static inline void setAddress(uint16_t address)
+{
+	Eeprom::addressHigh() = address >> 8;
+	Eeprom::addressLow() = (uint8_t)address;
+}
+
+// Reads one byte, once any write in progress has finished. Only for when the interrupt handler is not writing.
+static uint8_t readByte(uint16_t address)
+{
+	while (Eeprom::control() & _BV(EEPE))
+	{
+	}
+	setAddress(address);
+	Eeprom::control() |= _BV(EERE);
+	return Eeprom::data();
+}
+
+bool SettingsStore::isBusy()
+{
+	return g_bytesLeft != 0 || (Eeprom::control() & _BV(EEPE));
+}
+
+bool SettingsStore::load(Settings& settings)
+{
+	while (isBusy())
+	{
+	}
+
+	bool found = false;
+	uint16_t newest = 0;
+	uint16_t address = Eeprom::addressOf(ee_layout.settingsRing);
+	m_nextSlot = 0;
+	for (uint8_t slot = 0; slot < NUM_SLOTS; ++slot)
+	{
+		uint8_t record[RECORD_SIZE];
+		for (uint8_t i = 0; i < RECORD_SIZE; ++i)
+		{
+			record[i] = readByte(address++);
+		}
+		if (crc8(record, RECORD_SIZE - 1) != record[RECORD_SIZE - 1])
+		{
+			continue;	// Never written, or the write was cut short
+		}
+
+		// The ring only ever holds the last NUM_SLOTS sequence numbers, so the difference tells which is newer even
+		// once they have wrapped
+		uint16_t sequence = record[0] | ((uint16_t)record[1] << 8);
+		if (found && (int16_t)(sequence - newest) <= 0)
+		{
+			continue;
+		}
+		found = true;
+		newest = sequence;
+		memcpy(&settings, record + 2, sizeof(Settings));
+		m_nextSlot = slot + 1 < NUM_SLOTS ? slot + 1 : 0;
+	}
+	m_nextSequence = found ? newest + 1 : 0;
+	return found;
+}
+
+void SettingsStore::save(const Settings& settings)
+{
+	uint8_t record[RECORD_SIZE];
+	record[0] = (uint8_t)m_nextSequence;
+	record[1] = m_nextSequence >> 8;
+	memcpy(record + 2, &settings, sizeof(Settings));
+	record[RECORD_SIZE - 1] = crc8(record, RECORD_SIZE - 1);
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for (uint8_t i = 0; i < RECORD_SIZE; ++i)
+		{
+			g_record[i] = record[i];
+		}
+		saveBlock(ee_layout.settingsRing + m_nextSlot * RECORD_SIZE, g_record, RECORD_SIZE);
+	}
+
+	++m_nextSequence;
+	if (++m_nextSlot == NUM_SLOTS)
+	{
+		m_nextSlot = 0;
+	}
+}
+
+void SettingsStore::saveBlock(void* address, const volatile uint8_t* data, uint8_t length)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		g_source = data;
+		g_writeAddress = Eeprom::addressOf(address);
+		g_bytesLeft = length;
+		Eeprom::control() |= _BV(EERIE);	// Fires as soon as the EEPROM is ready, which may be straight away
+	}
+}
+
+// This interrupt handler is called whenever the EEPROM is ready for another write, while a save is underway. It starts
+// the write of the next byte that differs from what the EEPROM already holds, and disables itself once the block is
+// complete.
+ISR(EE_RDY_vect)
+{
+	while (g_bytesLeft != 0)
+	{
+		uint8_t value = *g_source;
+		++g_source;
+		setAddress(g_writeAddress);
+		++g_writeAddress;
+		--g_bytesLeft;
+
+		Eeprom::control() |= _BV(EERE);
+		if (Eeprom::data() != value)
+		{
+			Eeprom::data() = value;
+			Eeprom::control() = _BV(EERIE) | _BV(EEMPE);	// Atomic erase and write
+			Eeprom::control() |= _BV(EEPE);				// Must follow within four cycles of setting EEMPE
+			return;
+		}
+	}
+	Eeprom::control() &= ~_BV(EERIE);
+}
@@ -0,0 +1,63 @@
+/*
+* SettingsStore.h
+*
+* Created: 10/16/2026 6:12:48 PM
+*/
+
+
+#ifndef __SETTINGSSTORE_H__
+#define __SETTINGSSTORE_H__
+
+#include "Hal.h"
+
+// Everything that is saved across power cycles
+struct Settings
+{
+	uint16_t stopDistanceMm;	// Converted from temperature-compensated echo ticks, so valid at any temperature
+};
+
+// Keeps the settings in EEPROM as a ring of records, each with a sequence number and a CRC. Each save goes to the slot
+// after the newest record, so wear is spread over the whole ring, and a save that is cut short (by a reset or power
+// loss) leaves a record that fails its CRC, with the one before it still intact.
+//
+// Saves are written in the background by the EEPROM ready interrupt handler, one byte per 3.4ms write, skipping bytes
+// that already hold the right value. EE_RDY does not wake the CPU from power-down, so don't power down while isBusy().
+// Other blocks kept in EEPROM (see EepromLayout.h) are written by the same interrupt handler, with saveBlock().
+class SettingsStore
+{
+//variables
+public:
+	static const uint8_t NUM_SLOTS = 64;
+	static const uint8_t RECORD_SIZE = 3 + sizeof(Settings);	// Sequence number, settings, CRC
+protected:
+private:
+	uint8_t m_nextSlot;
+	uint16_t m_nextSequence;
+
+//functions
+public:
+	SettingsStore();
+	~SettingsStore();
+
+	// Finds the newest valid record. Returns false if there is none: nothing has been saved yet, or every record is
+	// corrupt. Blocks while a save is underway.
+	bool load(Settings& settings);
+
+	// Starts saving in the background and returns straight away. A save while another is still underway abandons the
+	// earlier one, which is left as a record that fails its CRC.
+	void save(const Settings& settings);
+
+	// Starts writing 'length' bytes from 'data' to the EEMEM block at 'address' in the background, the same way, and
+	// abandoning any save underway. The bytes are read as they are written, so they must not change until !isBusy().
+	static void saveBlock(void* address, const volatile uint8_t* data, uint8_t length);
+
+	static bool isBusy();
+
+protected:
+private:
+	SettingsStore( const SettingsStore &c );
+	SettingsStore& operator=( const SettingsStore &c );
+
+}; //SettingsStore
+
+#endif //__SETTINGSSTORE_H__
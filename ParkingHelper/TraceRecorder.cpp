@@ -0,0 +1,117 @@
+/*
+* TraceRecorder.cpp
+*
+* Created: 10/16/2026 10:58:14 PM
+*/
+
+#include "TraceRecorder.h"
+#include "SettingsStore.h"
+#include "Crc8.h"
+#include "EepromLayout.h"
+#include <stddef.h>
+
+#if defined(TRACE)
+
+static TraceBlock g_trace = { TraceRecorder::TRACE_MAGIC, 0, 0, 0, { 0 }, 0 };
+static uint8_t g_oldest = 0;		// Index in g_trace.data of the oldest sample
+static uint32_t g_lastTime = 0;		// Of the newest sample
+static uint16_t g_lastEcho = 0;
+static bool g_freezing = false;
+
+static inline uint8_t ringIndex(uint8_t index)
+{
+	return index < TraceRecorder::TRACE_BYTES ? index : index - TraceRecorder::TRACE_BYTES;
+}
+
+static uint8_t putVarint(uint8_t* out, uint32_t value)
+{
+	uint8_t length = 0;
+	while (value >= 0x80)
+	{
+		out[length++] = (uint8_t)value | 0x80;
+		value >>= 7;
+	}
+	out[length++] = (uint8_t)value;
+	return length;
+}
+
+// Reads the varint at the oldest end of the ring, and moves past it
+static uint32_t takeVarint()
+{
+	uint32_t value = 0;
+	uint8_t shift = 0;
+	uint8_t b;
+	do
+	{
+		b = g_trace.data[g_oldest];
+		g_oldest = ringIndex(g_oldest + 1);
+		--g_trace.length;
+		value |= (uint32_t)(b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	return value;
+}
+
+// Folds the oldest sample into the values the rest are relative to
+static void dropOldest()
+{
+	g_trace.time += takeVarint();
+	uint16_t zigzag = takeVarint() >> 2;
+	g_trace.echo += (zigzag >> 1) ^ -(zigzag & 1);
+}
+
+static void reverse(uint8_t first, uint8_t last)
+{
+	while (first + 1 < last)
+	{
+		uint8_t b = g_trace.data[first];
+		g_trace.data[first++] = g_trace.data[--last];
+		g_trace.data[last] = b;
+	}
+}
+
+void TraceRecorder::record(uint32_t time, uint16_t echo, uint8_t state)
+{
+	if (g_freezing)
+	{
+		if (SettingsStore::isBusy())
+		{
+			return;
+		}
+		g_freezing = false;
+	}
+
+	uint8_t sample[MAX_SAMPLE_BYTES];
+	int16_t delta = (int16_t)(echo - g_lastEcho);
+	uint16_t zigzag = ((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15);
+	uint8_t length = putVarint(sample, time - g_lastTime);
+	length += putVarint(sample + length, ((uint32_t)zigzag << 2) | state);
+	g_lastTime = time;
+	g_lastEcho = echo;
+
+	while (TRACE_BYTES - g_trace.length < length)
+	{
+		dropOldest();
+	}
+	uint8_t next = ringIndex(g_oldest + g_trace.length);
+	for (uint8_t i = 0; i < length; ++i)
+	{
+		g_trace.data[next] = sample[i];
+		next = ringIndex(next + 1);
+	}
+	g_trace.length += length;
+}
+
+// Rotates the ring so that the oldest sample is at the start, which keeps it a valid ring, then writes the whole block
+void TraceRecorder::freeze()
+{
+	reverse(0, g_oldest);
+	reverse(g_oldest, TRACE_BYTES);
+	reverse(0, TRACE_BYTES);
+	g_oldest = 0;
+	g_trace.crc = crc8((const uint8_t*)&g_trace, offsetof(TraceBlock, crc));
+	SettingsStore::saveBlock(&ee_layout.trace, (const uint8_t*)&g_trace, offsetof(TraceBlock, crc) + 1);
+	g_freezing = true;
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+* TraceRecorder.h
+*
+* Created: 10/16/2026 10:58:14 PM
+*/
+
+
+#ifndef __TRACERECORDER_H__
+#define __TRACERECORDER_H__
+
+#include "Hal.h"
+
+// Keeps the latest readings, as a ring of delta-encoded samples, for working out afterwards what a unit that
+// misbehaved was seeing. The oldest samples are dropped as new ones need the room. freeze() copies the trace into
+// EEPROM, in the background, where it survives a power cycle until the next freeze; host/TraceDecoder.cpp turns an
+// EEPROM dump back into a CSV.
+//
+// Compiled in only when TRACE is defined, as it takes over a fifth of the ATtiny85's SRAM; otherwise every function is
+// an empty inline. The format is TraceBlock, below. Sample times are scheduler time, which stands still while dormant,
+// so readings taken in IDLE show up only seconds apart.
+class TraceRecorder
+{
+//variables
+public:
+	static const uint8_t TRACE_MAGIC = 0x54;
+	static const uint8_t TRACE_BYTES = 96;			// About 45 readings in ACTIVE
+	static const uint8_t MAX_SAMPLE_BYTES = 5 + 3;
+
+#if defined(TRACE)
+	static const bool ENABLED = true;
+#else
+	static const bool ENABLED = false;
+#endif
+protected:
+private:
+
+//functions
+public:
+#if defined(TRACE)
+	// Adds a sample, unless a freeze is still being written
+	static void record(uint32_t time, uint16_t echo, uint8_t state);
+
+	// Starts writing the trace to EEPROM. Recording stops until it has been written.
+	static void freeze();
+#else
+	static inline void record(uint32_t, uint16_t, uint8_t) {}
+	static inline void freeze() {}
+#endif
+
+protected:
+private:
+	TraceRecorder();
+	TraceRecorder( const TraceRecorder &c );
+	TraceRecorder& operator=( const TraceRecorder &c );
+
+}; //TraceRecorder
+
+// The trace as it is kept in SRAM and frozen to EEPROM. Each sample is two little-endian base-128 varints (low 7 bits
+// first, the top bit set on all but the last byte):
+//   - scheduler ticks since the previous sample
+//   - the change in raw echo ticks from the previous sample (modulo 2^16, zigzag encoded so that small changes either
+//     way are small numbers), shifted left by 2, ORed with the ParkingHelper state after the reading was handled
+// so a reading in ACTIVE usually takes two bytes. 'time' and 'echo' are the values the oldest sample is relative to.
+struct TraceBlock
+{
+	uint8_t magic;			// TraceRecorder::TRACE_MAGIC
+	uint8_t length;			// Bytes of samples in 'data'
+	uint16_t echo;
+	uint32_t time;
+	uint8_t data[TraceRecorder::TRACE_BYTES];	// A ring starting at the oldest sample; at data[0] once frozen
+	uint8_t crc;			// crc8() of everything before it
+};
+
+#endif //__TRACERECORDER_H__
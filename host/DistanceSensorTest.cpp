@@ -0,0 +1,109 @@
+/*
+* DistanceSensorTest.cpp
+*
+* Created: 10/17/2026 3:05:48 PM
+*/
+
+// Reads two Ping))) sensors, on PB1 and PB4, through one DistanceSensor, re-requesting each reading as soon as it
+// completes. Checks that a sensor beyond the table is refused, that the sensors take turns rather than the first one
+// requested starving the other, and that each reading is of its own sensor's distance.
+
+#include "HostSimulator.h"
+#include "DistanceSensor.h"
+#include "Scheduler.h"
+#include <stdio.h>
+
+const uint8_t NUM_SENSORS = 2;
+const uint16_t FIRST_MM = 500;
+const uint16_t SECOND_MM = 1200;
+const uint16_t TOLERANCE_MM = 10;
+const uint8_t NUM_READINGS = 20;
+
+const Waypoint firstWaypoints[] = { { 0, FIRST_MM } };
+const Waypoint secondWaypoints[] = { { 0, SECOND_MM } };
+
+static void timedOut()
+{
+	hostExpect(false, "timed out with readings outstanding");
+}
+
+const Scenario distanceSensorScenario = {
+	"distance_sensor", firstWaypoints, NELEMS(firstWaypoints), secondWaypoints, NELEMS(secondWaypoints), 0, 0, 10000, 0,
+	timedOut
+};
+
+static Scheduler g_scheduler;
+static volatile bool g_due = false;
+static volatile bool g_echoDone = false;
+
+static void timersDue()
+{
+	g_due = true;
+}
+
+static void echoComplete()
+{
+	g_echoDone = true;
+}
+
+int main()
+{
+	hostSetScenario(&distanceSensorScenario);
+	sei();
+
+	g_scheduler.setDueHandler(timersDue);
+	DistanceSensorFixed<NUM_SENSORS> sensors(PB1, &g_scheduler);
+	DistanceSensorFixed<> single(PB1, &g_scheduler);
+	hostExpect(sensors.addSensor(PB4) == 1, "second sensor not given id 1");
+	hostExpect(sensors.addSensor(PB3) == DistanceSensor::NO_SENSOR, "sensor accepted beyond a table of %u", NUM_SENSORS);
+	hostExpect(single.addSensor(PB4) == DistanceSensor::NO_SENSOR, "sensor accepted beyond a table of one");
+	sensors.setEchoCompleteHandler(echoComplete);
+	g_scheduler.start();
+
+	// Sensor 0 is requested first, and again each time it completes, so only the round robin gives sensor 1 a turn
+	const uint16_t expectedMm[NUM_SENSORS] = { FIRST_MM, SECOND_MM };
+	uint8_t order[NUM_READINGS];
+	uint8_t numReadings = 0;
+	sensors.startCapture(0);
+	sensors.startCapture(1);
+	while (numReadings < NUM_READINGS)
+	{
+		cli();
+		if (!g_due && !g_echoDone)
+		{
+			Sleep::sleep(Sleep::IDLE);
+		}
+		sei();
+		if (g_echoDone)
+		{
+			g_echoDone = false;
+			sensors.completeCapture();
+		}
+		if (g_due)
+		{
+			g_due = false;
+			g_scheduler.runDue();
+		}
+		for (uint8_t sensor = 0; sensor < NUM_SENSORS && numReadings < NUM_READINGS; ++sensor)
+		{
+			if (sensors.hasCapture(sensor))
+			{
+				uint16_t mm = ECHO_TICKS_TO_MM(sensors.getCaptureAndClear(sensor));
+				hostExpect(mm + TOLERANCE_MM >= expectedMm[sensor] && mm <= expectedMm[sensor] + TOLERANCE_MM,
+					"reading %u, from sensor %u: %u mm, expected %u mm", numReadings, sensor, mm, expectedMm[sensor]);
+				order[numReadings++] = sensor;
+				sensors.startCapture(sensor);
+			}
+		}
+	}
+
+	for (uint8_t i = 0; i < NUM_READINGS; ++i)
+	{
+		hostExpect(order[i] == i % NUM_SENSORS, "reading %u from sensor %u, expected sensor %u", i, order[i],
+			i % NUM_SENSORS);
+	}
+	hostExpect(hostStats().triggers >= NUM_READINGS, "%u triggers for %u readings", hostStats().triggers, NUM_READINGS);
+
+	printf("%s: %s\n", distanceSensorScenario.name, hostPassed() ? "passed" : "FAILED");
+	return hostPassed() ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+/* 
+* HalHost.h
+*
+* Created: 10/16/2026 10:02:17 AM
+*/
+
+
+#ifndef __HALHOST_H__
+#define __HALHOST_H__
+
+// Host (x86 Linux) implementation of the HAL. Registers are HostRegister objects whose reads and writes can be hooked
+// by the simulator, interrupt vectors become plain extern "C" functions the simulator calls, and the avr-libc names
+// the firmware uses outside the HAL (bit numbers, ISR(), ATOMIC_BLOCK(), EEMEM, PROGMEM) are provided with the same
+// meaning.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define _BV(bit) (1 << (bit))
+
+// Interrupt vectors. The simulator declares each one weak, so firmware only defines the handlers it uses.
+#define ISR_NOBLOCK
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+#define PCINT0_vect hostVectorPcint0
+#define TIMER1_COMPA_vect hostVectorTimer1CompareA
+#define TIMER1_OVF_vect hostVectorTimer1Overflow
+#define TIMER0_OVF_vect hostVectorTimer0Overflow
+#define EE_RDY_vect hostVectorEepromReady
+#define TIMER0_COMPA_vect hostVectorTimer0CompareA
+#define TIMER0_COMPB_vect hostVectorTimer0CompareB
+#define WDT_vect hostVectorWatchdog
+
+// Interrupts only run when the simulator dispatches them (inside Sleep::sleep() and Delay), so there is nothing for an
+// atomic block to guard against.
+#define ATOMIC_BLOCK(type) for (uint8_t hostAtomicOnce = 1; hostAtomicOnce; hostAtomicOnce = 0)
+#define ATOMIC_FORCEON
+#define ATOMIC_RESTORESTATE
+
+// EEMEM variables are placed in a section of their own, which is the simulated EEPROM. The EEPROM address of a variable
+// is its offset from the start of the section. The section bounds are weak, so that a test without EEMEM variables has an
+// EEPROM of no size rather than a link error.
+#define EEMEM __attribute__((section("host_eeprom")))
+extern "C" uint8_t __start_host_eeprom[] __attribute__((weak));
+extern "C" uint8_t __stop_host_eeprom[] __attribute__((weak));
+
+// There is only one address space on the host, so PROGMEM tables are ordinary constants
+#define PROGMEM
+
+// ATtiny85 register bit numbers
+enum { PB0 = 0, PB1, PB2, PB3, PB4, PB5 };
+enum { DDB0 = 0, DDB1, DDB2, DDB3, DDB4, DDB5 };
+enum { WGM00 = 0, WGM01 = 1 };													// TCCR0A
+enum { CS00 = 0, CS01 = 1, CS02 = 2, WGM02 = 3 };								// TCCR0B
+enum { CS10 = 0, CS11 = 1, CS12 = 2, CS13 = 3, CTC1 = 7 };						// TCCR1
+enum { TOIE0 = 1, OCIE0B = 3, OCIE0A = 4, TOIE1 = 2, OCIE1B = 5, OCIE1A = 6 };	// TIMSK
+enum { TOV0 = 1, OCF0B = 3, OCF0A = 4, TOV1 = 2, OCF1B = 5, OCF1A = 6 };		// TIFR
+enum { PCIE = 5 };																// GIMSK
+enum { PCIF = 5 };																// GIFR
+enum { USITC = 0, USICLK = 1, USICS0 = 2, USICS1 = 3, USIWM0 = 4, USIWM1 = 5 };	// USICR
+enum { WDP0 = 0, WDP1, WDP2, WDE, WDCE, WDP3, WDIE, WDIF };						// WDTCR
+enum { ACD = 7 };																// ACSR
+enum { MUX0 = 0, MUX1, MUX2, MUX3, REFS2, ADLAR, REFS0, REFS1 };				// ADMUX
+enum { ADPS0 = 0, ADPS1, ADPS2, ADIE, ADIF, ADATE, ADSC, ADEN };				// ADCSRA
+enum { EERE = 0, EEPE, EEMPE, EERIE, EEPM0, EEPM1 };								// EECR
+
+void sei();
+void cli();
+
+// A simulated 8-bit I/O register
+struct HostRegister
+{
+	uint8_t value;
+	uint8_t (*onRead)(const HostRegister& reg);
+	void (*onWrite)(HostRegister& reg, uint8_t value);
+	
+	operator uint8_t() const { return onRead ? onRead(*this) : value; }
+	HostRegister& operator=(uint8_t v) { if (onWrite) onWrite(*this, v); else value = v; return *this; }
+	HostRegister& operator|=(uint8_t v) { return *this = (uint8_t)(*this | v); }
+	HostRegister& operator&=(uint8_t v) { return *this = (uint8_t)(*this & v); }
+	HostRegister& operator^=(uint8_t v) { return *this = (uint8_t)(*this ^ v); }
+};
+
+typedef HostRegister Reg8;
+
+extern HostRegister hostPORTB, hostDDRB, hostPINB;
+extern HostRegister hostTCCR0A, hostTCCR0B, hostTCNT0, hostOCR0A, hostOCR0B;
+extern HostRegister hostTCCR1, hostTCNT1, hostOCR1A, hostOCR1B, hostOCR1C;
+extern HostRegister hostTIMSK, hostTIFR;
+extern HostRegister hostGIMSK, hostGIFR, hostPCMSK;
+extern HostRegister hostUSICR, hostUSIDR, hostUSISR;
+extern HostRegister hostWDTCR, hostACSR;
+extern HostRegister hostADMUX, hostADCSRA, hostADCL, hostADCH;
+extern HostRegister hostEECR, hostEEDR, hostEEARL, hostEEARH;
+
+struct PortB
+{
+	static Reg8& port() { return hostPORTB; }
+	static Reg8& ddr() { return hostDDRB; }
+	static Reg8& pin() { return hostPINB; }
+};
+
+struct Timer0
+{
+	static Reg8& controlA() { return hostTCCR0A; }
+	static Reg8& controlB() { return hostTCCR0B; }
+	static Reg8& counter() { return hostTCNT0; }
+	static Reg8& compareA() { return hostOCR0A; }
+	static Reg8& compareB() { return hostOCR0B; }
+};
+
+struct Timer1
+{
+	static Reg8& control() { return hostTCCR1; }
+	static Reg8& counter() { return hostTCNT1; }
+	static Reg8& compareA() { return hostOCR1A; }
+	static Reg8& compareB() { return hostOCR1B; }
+	static Reg8& compareC() { return hostOCR1C; }
+};
+
+struct TimerInterrupts
+{
+	static Reg8& mask() { return hostTIMSK; }
+	static Reg8& flags() { return hostTIFR; }
+};
+
+struct PinChangeInterrupts
+{
+	static Reg8& control() { return hostGIMSK; }
+	static Reg8& flags() { return hostGIFR; }
+	static Reg8& mask() { return hostPCMSK; }
+};
+
+struct Usi
+{
+	static Reg8& control() { return hostUSICR; }
+	static Reg8& data() { return hostUSIDR; }
+	static Reg8& status() { return hostUSISR; }
+};
+
+struct Watchdog
+{
+	static Reg8& control() { return hostWDTCR; }
+};
+
+struct AnalogComparator
+{
+	static Reg8& control() { return hostACSR; }
+};
+
+struct Adc
+{
+	static Reg8& multiplexer() { return hostADMUX; }
+	static Reg8& control() { return hostADCSRA; }
+	static uint16_t result() { uint8_t low = hostADCL; return low | (hostADCH << 8); }
+};
+
+// EEMEM variables are ordinary RAM on the host, so the blocking accessors read them directly; the registers reach the
+// same bytes through the simulator
+struct Eeprom
+{
+	static Reg8& control() { return hostEECR; }
+	static Reg8& data() { return hostEEDR; }
+	static Reg8& addressLow() { return hostEEARL; }
+	static Reg8& addressHigh() { return hostEEARH; }
+	
+	static uint16_t addressOf(const void* variable) { return (uint16_t)((const uint8_t*)variable - __start_host_eeprom); }
+	
+	static uint32_t readDword(const uint32_t* address) { return *address; }
+};
+
+struct Flash
+{
+	static uint8_t readByte(const uint8_t* address) { return *address; }
+	static uint16_t readWord(const uint16_t* address) { return *address; }
+	static uint32_t readDword(const uint32_t* address) { return *address; }
+	template <class T> static T* readPointer(T* const* address) { return *address; }
+};
+
+// Advances simulated time, running any interrupts that come due in the meantime
+void hostDelayCycles(uint32_t cycles);
+
+struct Delay
+{
+	template <uint16_t US> static void us() { hostDelayCycles(US * (F_CPU / 1000000UL)); }
+	template <uint16_t MS> static void ms() { hostDelayCycles(MS * (F_CPU / 1000UL)); }
+};
+
+// Advances simulated time to the next interrupt that wakes the CPU from the given sleep mode
+void hostSleep(uint8_t mode);
+
+struct Sleep
+{
+	static const uint8_t IDLE = 0;
+	static const uint8_t POWER_DOWN = 2;
+	
+	static void sleep(uint8_t mode) { hostSleep(mode); }
+};
+
+#endif //__HALHOST_H__
@@ -0,0 +1,999 @@
+/*
+* HostSimulator.cpp
+*
+* Created: 10/16/2026 10:41:05 AM
+*/
+
+// Host-side model of the parts of the ATtiny85 and the board that the firmware touches: PORTB with the Ping))) sensor
+// on PB1, the button on PB3 and the LPD8806 strip on PB0 (data) / PB2 (clock), Timer0, Timer1, the pin change
+// interrupt, the USI, the watchdog interrupt, the EEPROM and the ADC, and on PB4 either a second Ping))) sensor, if the
+// scenario has waypoints for one, or, when built with INSTRUMENTATION, a serial receiver. Time advances only when the firmware sleeps or busy-waits, in whole CPU cycles, from one hardware
+// event to the next, so simulating hours of IDLE is quick.
+//
+// The firmware's main() runs unchanged. A scenario (see HostSimulator.h) drives the distance seen by the sensor and the
+// button; LED frames are decoded from the strip's data/clock lines and printed whenever they change, and a summary is
+// printed at the end, including how much of the time the CPU spent awake and in each sleep mode.
+
+#include "HostSimulator.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const uint64_t CYCLES_PER_MS = F_CPU / 1000;
+const uint64_t CYCLES_PER_US = F_CPU / 1000000;
+const uint64_t NEVER = ~(uint64_t)0;
+
+const uint8_t BUTTON_PIN = PB3;
+const uint8_t LED_DATA_PIN = PB0;
+const uint8_t LED_CLOCK_PIN = PB2;
+const uint8_t SERIAL_PIN = PB4;
+
+const double AMBIENT_CELSIUS = 15;		// The firmware's readings are scaled to the speed of sound at 15C
+const uint16_t PING_MAX_RANGE_MM = 3000;
+const uint64_t PING_HOLDOFF_CYCLES = 750 * CYCLES_PER_US;
+const uint64_t PING_NO_OBJECT_CYCLES = 18500 * CYCLES_PER_US;
+
+// Until a scenario is set: nothing in range, and the run ends at the first sleep
+static const Scenario g_emptyScenario = { "empty", 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+static const Scenario* g_scenario = &g_emptyScenario;
+
+static uint64_t g_now = 0;
+static bool g_interruptsEnabled = false;
+static HostStats g_stats;
+static bool g_failed = false;
+
+void hostSetScenario(const Scenario* scenario)
+{
+	g_scenario = scenario;
+}
+
+uint64_t hostNow()
+{
+	return g_now;
+}
+
+uint32_t hostMillis()
+{
+	return (uint32_t)(g_now / CYCLES_PER_MS);
+}
+
+const HostStats& hostStats()
+{
+	return g_stats;
+}
+
+bool hostExpect(bool condition, const char* format, ...)
+{
+	if (!condition)
+	{
+		va_list args;
+		va_start(args, format);
+		printf("FAIL: ");
+		vprintf(format, args);
+		putchar('\n');
+		va_end(args);
+		g_failed = true;
+	}
+	return condition;
+}
+
+bool hostPassed()
+{
+	return !g_failed;
+}
+
+//
+// Registers
+//
+
+static uint8_t readPinb(const HostRegister& reg);
+static void writePort(HostRegister& reg, uint8_t value);
+static void writeFlags(HostRegister& reg, uint8_t value);
+static uint8_t readTimer0Counter(const HostRegister& reg);
+static uint8_t readTimer1Counter(const HostRegister& reg);
+static void writeTimer0(HostRegister& reg, uint8_t value);
+static void writeTimer1(HostRegister& reg, uint8_t value);
+static void writePcmsk(HostRegister& reg, uint8_t value);
+static void writeUsiControl(HostRegister& reg, uint8_t value);
+static void writeWatchdog(HostRegister& reg, uint8_t value);
+static uint8_t readEepromControl(const HostRegister& reg);
+static void writeEepromControl(HostRegister& reg, uint8_t value);
+static void writeAdcControl(HostRegister& reg, uint8_t value);
+
+HostRegister hostPORTB = { 0, 0, writePort };
+HostRegister hostDDRB = { 0, 0, writePort };
+HostRegister hostPINB = { 0, readPinb, 0 };
+HostRegister hostTCCR0A = { 0, 0, writeTimer0 };
+HostRegister hostTCCR0B = { 0, 0, writeTimer0 };
+HostRegister hostTCNT0 = { 0, readTimer0Counter, writeTimer0 };
+HostRegister hostOCR0A = { 0, 0, writeTimer0 };
+HostRegister hostOCR0B = { 0, 0, 0 };
+HostRegister hostTCCR1 = { 0, 0, writeTimer1 };
+HostRegister hostTCNT1 = { 0, readTimer1Counter, writeTimer1 };
+HostRegister hostOCR1A = { 0, 0, 0 };
+HostRegister hostOCR1B = { 0, 0, 0 };
+HostRegister hostOCR1C = { 0, 0, writeTimer1 };
+HostRegister hostTIMSK = { 0, 0, 0 };
+HostRegister hostTIFR = { 0, 0, writeFlags };
+HostRegister hostGIMSK = { 0, 0, 0 };
+HostRegister hostGIFR = { 0, 0, writeFlags };
+HostRegister hostPCMSK = { 0, 0, writePcmsk };
+HostRegister hostUSICR = { 0, 0, writeUsiControl };
+HostRegister hostUSIDR = { 0, 0, 0 };
+HostRegister hostUSISR = { 0, 0, 0 };
+HostRegister hostWDTCR = { 0, 0, writeWatchdog };
+HostRegister hostACSR = { 0, 0, 0 };
+HostRegister hostEECR = { 0, readEepromControl, writeEepromControl };
+HostRegister hostEEDR = { 0, 0, 0 };
+HostRegister hostEEARL = { 0, 0, 0 };
+HostRegister hostEEARH = { 0, 0, 0 };
+HostRegister hostADMUX = { 0, 0, 0 };
+HostRegister hostADCSRA = { 0, 0, writeAdcControl };
+HostRegister hostADCL = { 0, 0, 0 };
+HostRegister hostADCH = { 0, 0, 0 };
+HostRegister g_eepromReady = { 0, 0, 0 };	// Not a register: bit 0 is the level of the EEPROM ready interrupt
+
+void sei()
+{
+	g_interruptsEnabled = true;
+}
+
+void cli()
+{
+	g_interruptsEnabled = false;
+}
+
+// Interrupt flag registers are cleared by writing a one
+static void writeFlags(HostRegister& reg, uint8_t value)
+{
+	reg.value &= ~value;
+}
+
+//
+// EEPROM. The firmware's EEMEM variables are the EEPROM contents (see HalHost.h). Only atomic erase-and-write is
+// modelled; each write takes 3.4ms, during which EEPE reads as set, and the ready interrupt is pending whenever no
+// write is in progress.
+//
+
+const uint64_t EEPROM_WRITE_CYCLES = 3400 * CYCLES_PER_US;
+
+static uint64_t g_eepromBusyUntil = 0;
+static uint32_t g_eepromWritesAt[4096];
+
+// An erased EEPROM reads as all ones. Runs before the firmware's static constructors, which may load settings.
+__attribute__((constructor(101))) static void eraseEeprom()
+{
+	memset(__start_host_eeprom, 0xFF, __stop_host_eeprom - __start_host_eeprom);
+}
+
+// Writes the EEPROM contents to the file named by PARKING_HELPER_EEPROM, if it is set, as avrdude would read them back
+// from a device (e.g. for host/TraceDecoder.cpp)
+static void dumpEeprom()
+{
+	const char* path = getenv("PARKING_HELPER_EEPROM");
+	if (!path)
+	{
+		return;
+	}
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		perror(path);
+		return;
+	}
+	fwrite(__start_host_eeprom, 1, __stop_host_eeprom - __start_host_eeprom, file);
+	fclose(file);
+}
+
+uint32_t hostEepromWritesAt(uint16_t address)
+{
+	return address < sizeof(g_eepromWritesAt) / sizeof(g_eepromWritesAt[0]) ? g_eepromWritesAt[address] : 0;
+}
+
+static bool isEepromBusy()
+{
+	return g_now < g_eepromBusyUntil;
+}
+
+static uint64_t nextEepromEvent()
+{
+	return isEepromBusy() && (hostEECR.value & _BV(EERIE)) ? g_eepromBusyUntil : NEVER;
+}
+
+static uint8_t readEepromControl(const HostRegister& reg)
+{
+	return isEepromBusy() ? reg.value | _BV(EEPE) : reg.value;
+}
+
+// EERE and EEPE are strobes. EEPE only starts a write if EEMPE was already set, which the simulator treats as being
+// within the four cycle window since instructions take no time.
+static void writeEepromControl(HostRegister& reg, uint8_t value)
+{
+	uint16_t address = ((hostEEARH.value & 0x01) << 8) | hostEEARL.value;
+	bool inRange = address < __stop_host_eeprom - __start_host_eeprom;
+	if ((value & _BV(EERE)) && !isEepromBusy())
+	{
+		hostEEDR.value = inRange ? __start_host_eeprom[address] : 0xFF;
+	}
+	if ((value & _BV(EEPE)) && (reg.value & _BV(EEMPE)) && !isEepromBusy())
+	{
+		if (inRange)
+		{
+			__start_host_eeprom[address] = hostEEDR.value;
+			++g_eepromWritesAt[address];
+		}
+		g_eepromBusyUntil = g_now + EEPROM_WRITE_CYCLES;
+		++g_stats.eepromWrites;
+		value &= ~_BV(EEMPE);
+	}
+	reg.value = value & ~(_BV(EERE) | _BV(EEPE));
+}
+
+//
+// ADC. Only the temperature sensor channel is modelled, with the typical response from the datasheet (230 at -40C, 300
+// at 25C, 370 at 85C). Conversions complete as soon as they are started.
+//
+
+static uint16_t temperatureSensorReading(double celsius)
+{
+	double perDegree = celsius < 25 ? 70.0 / 65 : 70.0 / 60;
+	return (uint16_t)lround(300 + (celsius - 25) * perDegree);
+}
+
+static void writeAdcControl(HostRegister& reg, uint8_t value)
+{
+	if ((value & _BV(ADSC)) && (value & _BV(ADEN)))
+	{
+		bool temperatureChannel = (hostADMUX.value & 0x0F) == 0x0F;
+		uint16_t result = temperatureChannel ? temperatureSensorReading(AMBIENT_CELSIUS) : 0;
+		hostADCL.value = (uint8_t)result;
+		hostADCH.value = result >> 8;
+		++g_stats.adcConversions;
+		value = (value & ~_BV(ADSC)) | _BV(ADIF);
+	}
+	reg.value = value;
+}
+
+//
+// Interrupt vectors, in priority order
+//
+
+extern "C" void hostVectorPcint0(void) __attribute__((weak));
+extern "C" void hostVectorTimer1CompareA(void) __attribute__((weak));
+extern "C" void hostVectorTimer1Overflow(void) __attribute__((weak));
+extern "C" void hostVectorTimer0Overflow(void) __attribute__((weak));
+extern "C" void hostVectorEepromReady(void) __attribute__((weak));
+extern "C" void hostVectorTimer0CompareA(void) __attribute__((weak));
+extern "C" void hostVectorTimer0CompareB(void) __attribute__((weak));
+extern "C" void hostVectorWatchdog(void) __attribute__((weak));
+
+struct Vector
+{
+	const char* name;
+	void (*handler)(void);
+	HostRegister* flags;
+	uint8_t flagBit;
+	HostRegister* mask;
+	uint8_t maskBit;
+	uint32_t count;
+	bool running;
+};
+
+static Vector g_vectors[] = {
+	{ "PCINT0", hostVectorPcint0, &hostGIFR, PCIF, &hostGIMSK, PCIE, 0, false },
+	{ "TIMER1_COMPA", hostVectorTimer1CompareA, &hostTIFR, OCF1A, &hostTIMSK, OCIE1A, 0, false },
+	{ "TIMER1_OVF", hostVectorTimer1Overflow, &hostTIFR, TOV1, &hostTIMSK, TOIE1, 0, false },
+	{ "TIMER0_OVF", hostVectorTimer0Overflow, &hostTIFR, TOV0, &hostTIMSK, TOIE0, 0, false },
+	{ "EE_RDY", hostVectorEepromReady, &g_eepromReady, 0, &hostEECR, EERIE, 0, false },
+	{ "TIMER0_COMPA", hostVectorTimer0CompareA, &hostTIFR, OCF0A, &hostTIMSK, OCIE0A, 0, false },
+	{ "TIMER0_COMPB", hostVectorTimer0CompareB, &hostTIFR, OCF0B, &hostTIMSK, OCIE0B, 0, false },
+	{ "WDT", hostVectorWatchdog, &hostWDTCR, WDIF, &hostWDTCR, WDIE, 0, false },
+};
+const uint8_t NUM_VECTORS = sizeof(g_vectors) / sizeof(g_vectors[0]);
+
+// Runs every pending, enabled interrupt whose handler isn't already executing, if interrupts are globally enabled.
+// Handlers run to completion; one that busy-waits lets others nest, as they would with ISR_NOBLOCK. Returns true if any
+// handler ran.
+static bool dispatchInterrupts()
+{
+	bool ran = false;
+	while (g_interruptsEnabled)
+	{
+		g_eepromReady.value = isEepromBusy() ? 0 : 1;	// Level triggered, so never latched
+		Vector* vector = 0;
+		for (uint8_t i = 0; i < NUM_VECTORS && !vector; ++i)
+		{
+			Vector& v = g_vectors[i];
+			if (v.handler && !v.running && (v.flags->value & _BV(v.flagBit)) && (v.mask->value & _BV(v.maskBit)))
+			{
+				vector = &v;
+			}
+		}
+		if (!vector)
+		{
+			break;
+		}
+		vector->flags->value &= ~_BV(vector->flagBit);
+		++vector->count;
+		vector->running = true;
+		vector->handler();
+		vector->running = false;
+		g_interruptsEnabled = true;	// RETI
+		ran = true;
+	}
+	return ran;
+}
+
+//
+// Timers. Each counts at F_CPU / prescaler from an anchor (the cycle and count at the last register change) up to
+// 'top', then wraps.
+//
+
+struct SimTimer
+{
+	uint64_t anchorCycle;
+	uint32_t anchorCount;
+	uint32_t prescaler;		// Zero when stopped
+	uint32_t top;			// Counter wraps to zero after reaching top - 1
+};
+
+static SimTimer g_timer0 = { 0, 0, 0, 256 };
+static SimTimer g_timer1 = { 0, 0, 0, 256 };
+
+static uint64_t fullCount(const SimTimer& timer)
+{
+	return timer.prescaler ? timer.anchorCount + (g_now - timer.anchorCycle) / timer.prescaler : timer.anchorCount;
+}
+
+static uint8_t timerCounter(const SimTimer& timer)
+{
+	return (uint8_t)(fullCount(timer) % timer.top);
+}
+
+// Cycle at which the counter next becomes 'value', or NEVER
+static uint64_t nextTimeAtCount(const SimTimer& timer, uint32_t value)
+{
+	if (!timer.prescaler || value >= timer.top)
+	{
+		return NEVER;
+	}
+	uint64_t now = fullCount(timer);
+	uint64_t k = now - now % timer.top + value;
+	if (k <= now)
+	{
+		k += timer.top;
+	}
+	return timer.anchorCycle + (k - timer.anchorCount) * timer.prescaler;
+}
+
+static void reanchor(SimTimer& timer, uint32_t prescaler, uint32_t top, uint8_t counter)
+{
+	timer.anchorCycle = g_now;
+	timer.anchorCount = counter % top;
+	timer.prescaler = prescaler;
+	timer.top = top;
+}
+
+static void updateTimer0(uint8_t counter)
+{
+	static const uint16_t prescalers[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	bool ctc = hostTCCR0A.value & _BV(WGM01);
+	reanchor(g_timer0, prescalers[hostTCCR0B.value & 0x07], ctc ? hostOCR0A.value + 1 : 256, counter);
+}
+
+static void updateTimer1(uint8_t counter)
+{
+	uint8_t clockSelect = hostTCCR1.value & 0x0F;
+	bool ctc = hostTCCR1.value & _BV(CTC1);
+	reanchor(g_timer1, clockSelect ? 1UL << (clockSelect - 1) : 0, ctc ? hostOCR1C.value + 1 : 256, counter);
+}
+
+static uint8_t readTimer0Counter(const HostRegister&)
+{
+	return timerCounter(g_timer0);
+}
+
+static uint8_t readTimer1Counter(const HostRegister&)
+{
+	return timerCounter(g_timer1);
+}
+
+static void writeTimer0(HostRegister& reg, uint8_t value)
+{
+	uint8_t counter = &reg == &hostTCNT0 ? value : timerCounter(g_timer0);
+	reg.value = value;
+	updateTimer0(counter);
+}
+
+static void writeTimer1(HostRegister& reg, uint8_t value)
+{
+	uint8_t counter = &reg == &hostTCNT1 ? value : timerCounter(g_timer1);
+	reg.value = value;
+	updateTimer1(counter);
+}
+
+// Finds the next timer event. Returns its cycle, and the TIFR flags it raises in 'flags' (several events can fall on
+// the same cycle).
+static uint64_t nextTimerEvent(uint8_t& flags)
+{
+	const struct { uint64_t at; uint8_t flag; } events[] = {
+		{ g_timer0.top == 256 ? nextTimeAtCount(g_timer0, 0) : NEVER, _BV(TOV0) },	// No overflow in CTC mode
+		{ nextTimeAtCount(g_timer0, hostOCR0A.value), _BV(OCF0A) },
+		{ nextTimeAtCount(g_timer0, hostOCR0B.value), _BV(OCF0B) },
+		{ nextTimeAtCount(g_timer1, 0), _BV(TOV1) },
+		{ nextTimeAtCount(g_timer1, hostOCR1A.value), _BV(OCF1A) },
+		{ nextTimeAtCount(g_timer1, hostOCR1B.value), _BV(OCF1B) },
+	};
+	uint64_t next = NEVER;
+	flags = 0;
+	for (uint8_t i = 0; i < sizeof(events) / sizeof(events[0]); ++i)
+	{
+		if (events[i].at < next)
+		{
+			next = events[i].at;
+			flags = 0;
+		}
+		if (events[i].at == next)
+		{
+			flags |= events[i].flag;
+		}
+	}
+	return next;
+}
+
+// In power-down the system clock stops, and the timers with it
+static void freezeTimers()
+{
+	reanchor(g_timer0, 0, g_timer0.top, timerCounter(g_timer0));
+	reanchor(g_timer1, 0, g_timer1.top, timerCounter(g_timer1));
+}
+
+static void thawTimers()
+{
+	updateTimer0(timerCounter(g_timer0));
+	updateTimer1(timerCounter(g_timer1));
+}
+
+//
+// Watchdog, in interrupt mode only (a watchdog reset is not modelled). It runs from its own 128kHz oscillator, so it
+// keeps counting in every sleep mode.
+//
+
+static uint64_t g_watchdogAnchor = 0;	// Cycle at which the current watchdog period started
+
+static uint64_t watchdogPeriod()
+{
+	uint8_t prescale = (hostWDTCR.value & 0x07) | ((hostWDTCR.value & _BV(WDP3)) ? 0x08 : 0);
+	return (16 * CYCLES_PER_MS) << prescale;	// 2K cycles of the 128kHz oscillator, doubled per prescale step
+}
+
+static uint64_t nextWatchdogEvent()
+{
+	return (hostWDTCR.value & _BV(WDIE)) ? g_watchdogAnchor + watchdogPeriod() : NEVER;
+}
+
+// WDIF is cleared by writing a one. Any change to the configuration restarts the period.
+static void writeWatchdog(HostRegister& reg, uint8_t value)
+{
+	uint8_t flag = reg.value & _BV(WDIF) & ~value;
+	uint8_t config = value & ~_BV(WDIF);
+	if (config != (reg.value & ~_BV(WDIF)))
+	{
+		g_watchdogAnchor = g_now;
+	}
+	reg.value = config | flag;
+}
+
+//
+// Pins, the Ping))) sensor and the button
+//
+
+// One per sensor pin: the scenario's waypoints for PB1, and its second waypoints for PB4
+struct PingSensor
+{
+	uint8_t pin;
+	bool echoHigh;
+	uint64_t echoRiseAt;
+	uint64_t echoFallAt;
+	bool triggerHigh;
+};
+
+static PingSensor g_pings[] = { { PB1, false, NEVER, NEVER, false }, { PB4, false, NEVER, NEVER, false } };
+static bool g_buttonDown = false;
+static uint8_t g_lastPins = 0;
+
+// Sensors the scenario has connected: the one on PB1 always, and the one on PB4 if it has waypoints
+static uint8_t numPings()
+{
+	return g_scenario->secondWaypoints ? 2 : 1;
+}
+
+static uint16_t scenarioDistanceMm(uint8_t sensor, uint64_t cycle)
+{
+	uint32_t ms = (uint32_t)(cycle / CYCLES_PER_MS);
+	return sensor ? hostDistanceMm(g_scenario->secondWaypoints, g_scenario->numSecondWaypoints, ms)
+		: hostDistanceMm(g_scenario->waypoints, g_scenario->numWaypoints, ms);
+}
+
+static bool scenarioButtonDown(uint64_t cycle)
+{
+	uint64_t ms = cycle / CYCLES_PER_MS;
+	for (uint8_t i = 0; i < g_scenario->numPresses; ++i)
+	{
+		const ButtonPress& press = g_scenario->presses[i];
+		if (ms >= press.ms && ms < press.ms + press.durationMs)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint64_t nextButtonChange()
+{
+	uint64_t next = NEVER;
+	for (uint8_t i = 0; i < g_scenario->numPresses; ++i)
+	{
+		const ButtonPress& press = g_scenario->presses[i];
+		uint64_t down = press.ms * CYCLES_PER_MS;
+		uint64_t up = (press.ms + press.durationMs) * CYCLES_PER_MS;
+		if (down > g_now && down < next)
+		{
+			next = down;
+		}
+		if (up > g_now && up < next)
+		{
+			next = up;
+		}
+	}
+	return next;
+}
+
+// Level on each PORTB pin: driven by the port when it is an output, otherwise by the outside world or the pull-up
+static uint8_t pinLevels()
+{
+	uint8_t ddr = hostDDRB.value;
+	uint8_t port = hostPORTB.value;
+	uint8_t external = port;	// Unconnected inputs follow their pull-up
+	for (uint8_t i = 0; i < numPings(); ++i)
+	{
+		const PingSensor& ping = g_pings[i];
+		external = ping.echoHigh ? external | _BV(ping.pin) : external & ~_BV(ping.pin);
+	}
+	if (g_buttonDown)
+	{
+		external &= ~_BV(BUTTON_PIN);
+	}
+	if (hostUSICR.value & _BV(USIWM0))
+	{
+		// Three-wire mode: DO follows the MSB of the USI data register
+		port = (hostUSIDR.value & 0x80) ? port | _BV(PB1) : port & ~_BV(PB1);
+	}
+	return (port & ddr) | (external & ~ddr);
+}
+
+static uint8_t readPinb(const HostRegister&)
+{
+	return pinLevels();
+}
+
+static void ledClockEdge(bool data);
+static void serialEdge(bool level);
+static uint64_t nextSerialSample();
+static void serialSampleUntil(uint64_t until);
+
+// Called whenever something may have changed a pin level: raises the pin change flag, detects the end of a trigger
+// pulse on a sensor pin, and clocks the LED strip
+static void pinsChanged()
+{
+	uint8_t pins = pinLevels();
+	uint8_t changed = pins ^ g_lastPins;
+	g_lastPins = pins;
+
+	if (changed & hostPCMSK.value)
+	{
+		hostGIFR.value |= _BV(PCIF);
+	}
+
+	for (uint8_t i = 0; i < numPings(); ++i)
+	{
+		PingSensor& ping = g_pings[i];
+		bool triggerHigh = (hostDDRB.value & hostPORTB.value) & _BV(ping.pin);
+		if (ping.triggerHigh && !triggerHigh)
+		{
+			// Trigger pulse complete. The sensor answers after its hold-off with a pulse as long as the round trip.
+			uint16_t mm = scenarioDistanceMm(i, g_now);
+			double speedMmPerSec = 331300 * sqrt(1 + AMBIENT_CELSIUS / 273.15);
+			uint64_t width = mm > PING_MAX_RANGE_MM ? PING_NO_OBJECT_CYCLES : (uint64_t)(2.0 * mm * F_CPU / speedMmPerSec);
+			ping.echoRiseAt = g_now + PING_HOLDOFF_CYCLES;
+			ping.echoFallAt = ping.echoRiseAt + width;
+			++g_stats.triggers;
+		}
+		ping.triggerHigh = triggerHigh;
+	}
+
+	if ((changed & _BV(LED_CLOCK_PIN)) && (pins & _BV(LED_CLOCK_PIN)) && (hostDDRB.value & _BV(LED_CLOCK_PIN)))
+	{
+		ledClockEdge(pins & _BV(LED_DATA_PIN));
+	}
+
+	if (numPings() == 1 && (changed & _BV(SERIAL_PIN)) && (hostDDRB.value & _BV(SERIAL_PIN)))
+	{
+		serialEdge(pins & _BV(SERIAL_PIN));
+	}
+}
+
+static void writePort(HostRegister& reg, uint8_t value)
+{
+	reg.value = value;
+	pinsChanged();
+}
+
+static void writePcmsk(HostRegister& reg, uint8_t value)
+{
+	reg.value = value;
+	g_lastPins = pinLevels();
+}
+
+// USITC toggles USCK (PB2) and USICLK shifts the data register, in that order for a single write
+static void writeUsiControl(HostRegister& reg, uint8_t value)
+{
+	reg.value = value & ~(_BV(USITC) | _BV(USICLK));
+	if (value & _BV(USITC))
+	{
+		hostPORTB.value ^= _BV(PB2);
+		pinsChanged();
+	}
+	if (value & _BV(USICLK))
+	{
+		hostUSIDR.value <<= 1;
+		pinsChanged();
+	}
+}
+
+static uint64_t nextExternalEvent()
+{
+	uint64_t next = nextButtonChange();
+	for (uint8_t i = 0; i < numPings(); ++i)
+	{
+		const PingSensor& ping = g_pings[i];
+		if (ping.echoRiseAt > g_now && ping.echoRiseAt < next)
+		{
+			next = ping.echoRiseAt;
+		}
+		if (ping.echoFallAt > g_now && ping.echoFallAt < next)
+		{
+			next = ping.echoFallAt;
+		}
+	}
+	uint64_t sample = nextSerialSample();
+	return sample < next ? sample : next;
+}
+
+static void applyExternalEvents()
+{
+	for (uint8_t i = 0; i < numPings(); ++i)
+	{
+		PingSensor& ping = g_pings[i];
+		if (ping.echoRiseAt == g_now)
+		{
+			ping.echoHigh = true;
+			ping.echoRiseAt = NEVER;
+		}
+		if (ping.echoFallAt == g_now)
+		{
+			ping.echoHigh = false;
+			ping.echoFallAt = NEVER;
+		}
+	}
+	g_buttonDown = scenarioButtonDown(g_now);
+	pinsChanged();
+	serialSampleUntil(g_now);
+}
+
+//
+// LED strip: bytes are clocked in MSB first on the clock's rising edge, three per pixel in the strip's BRG order, and a
+// zero byte latches the frame. Each colour byte is 0x80 | the 7-bit PWM level.
+//
+
+const uint16_t MAX_LED_BYTES = 3 * 128;
+
+static uint8_t g_ledShift = 0;
+static uint8_t g_ledBits = 0;
+static uint8_t g_ledBytes[MAX_LED_BYTES];
+static uint16_t g_ledByteCount = 0;
+static uint8_t g_shownBytes[MAX_LED_BYTES];
+static uint16_t g_shownByteCount = 0;
+
+static uint8_t wireColor(uint8_t wire)
+{
+	return wire & 0x7F;
+}
+
+static char pixelSymbol(uint8_t b, uint8_t r, uint8_t g)
+{
+	const uint8_t on = 0x20;
+	if (r < on && g < on && b < on)
+	{
+		return '.';
+	}
+	if (r >= on && g >= on && b < on)
+	{
+		return 'Y';
+	}
+	if (r >= g && r >= b)
+	{
+		return 'R';
+	}
+	return g >= b ? 'G' : 'B';
+}
+
+static void printTime()
+{
+	printf("%8llu.%03llu s  ", (unsigned long long)(g_now / F_CPU), (unsigned long long)(g_now / CYCLES_PER_MS % 1000));
+}
+
+static void ledFrameLatched()
+{
+	++g_stats.framesLatched;
+	if (g_ledByteCount == g_shownByteCount && memcmp(g_ledBytes, g_shownBytes, g_ledByteCount) == 0)
+	{
+		return;
+	}
+	++g_stats.framesChanged;
+	memcpy(g_shownBytes, g_ledBytes, g_ledByteCount);
+	g_shownByteCount = g_ledByteCount;
+
+	char leds[MAX_LED_BYTES / 3 + 1];
+	uint8_t count = 0;
+	for (uint16_t i = 0; i + 2 < g_shownByteCount; i += 3)
+	{
+		leds[count++] = pixelSymbol(wireColor(g_shownBytes[i]), wireColor(g_shownBytes[i + 1]), wireColor(g_shownBytes[i + 2]));
+	}
+	leds[count] = 0;
+
+	printTime();
+	printf("%5u mm  LEDs %s\n", scenarioDistanceMm(0, g_now), leds);
+	if (g_scenario->frameChanged)
+	{
+		g_scenario->frameChanged(hostMillis(), leds);
+	}
+}
+
+static void ledClockEdge(bool data)
+{
+	g_ledShift = (g_ledShift << 1) | (data ? 1 : 0);
+	if (++g_ledBits < 8)
+	{
+		return;
+	}
+	g_ledBits = 0;
+	if (g_ledShift)
+	{
+		if (g_ledByteCount < MAX_LED_BYTES)
+		{
+			g_ledBytes[g_ledByteCount++] = g_ledShift;
+		}
+	}
+	else if (g_ledByteCount)
+	{
+		ledFrameLatched();
+		g_ledByteCount = 0;
+	}
+}
+
+//
+// Serial receiver on PB4 for the instrumentation records (see Instrumentation.h): 8N1 at a nominal 9600 baud, so the
+// firmware's 9615 baud is checked against the rate a real receiver expects. Each bit is sampled mid-way, from the
+// level set by the last edge before that point.
+//
+
+const uint64_t SERIAL_BIT_CYCLES = F_CPU / 9600;
+const uint8_t SERIAL_RECORD_SIZE = 15;
+const uint8_t SERIAL_RECORD_SYNC = 0xA5;
+
+static bool g_serialLevel = true;
+static bool g_serialReceiving = false;
+static uint64_t g_serialStartAt = 0;	// Cycle of the falling edge of the start bit
+static uint8_t g_serialBit = 0;		// Next bit to sample: 0 start, 1-8 data
+static uint8_t g_serialShift = 0;
+static uint8_t g_serialRecord[SERIAL_RECORD_SIZE];
+static uint8_t g_serialCount = 0;
+
+static void serialRecordReceived()
+{
+	uint8_t sum = 0;
+	for (uint8_t i = 0; i + 1 < SERIAL_RECORD_SIZE; ++i)
+	{
+		sum += g_serialRecord[i];
+	}
+	if (sum != g_serialRecord[SERIAL_RECORD_SIZE - 1])
+	{
+		++g_stats.serialErrors;
+		return;
+	}
+	++g_stats.serialRecords;
+
+	static const char* const names[] = { "captures", "timeouts", "wakeups", "states", "shows", "late" };
+	printTime();
+	printf("         record ");
+	for (uint8_t i = 0; i < 6; ++i)
+	{
+		printf(" %s %u", names[i], g_serialRecord[1 + 2 * i] | (g_serialRecord[2 + 2 * i] << 8));
+	}
+	printf(" longest %u us\n", g_serialRecord[SERIAL_RECORD_SIZE - 2] * 4);
+}
+
+static void serialByteReceived(uint8_t value)
+{
+	if (g_serialCount == 0 && value != SERIAL_RECORD_SYNC)
+	{
+		++g_stats.serialErrors;
+		return;
+	}
+	g_serialRecord[g_serialCount++] = value;
+	if (g_serialCount == SERIAL_RECORD_SIZE)
+	{
+		serialRecordReceived();
+		g_serialCount = 0;
+	}
+}
+
+static uint64_t nextSerialSample()
+{
+	return g_serialReceiving ? g_serialStartAt + g_serialBit * SERIAL_BIT_CYCLES + SERIAL_BIT_CYCLES / 2 : NEVER;
+}
+
+// Takes the samples that fall before 'until', at the current level
+static void serialSampleUntil(uint64_t until)
+{
+	while (nextSerialSample() <= until)
+	{
+		if (g_serialBit == 0)
+		{
+			if (g_serialLevel)
+			{
+				g_serialReceiving = false;	// Glitch, not a start bit
+				++g_stats.serialErrors;
+			}
+		}
+		else
+		{
+			g_serialShift = (g_serialShift >> 1) | (g_serialLevel ? 0x80 : 0);
+			if (g_serialBit == 8)
+			{
+				// The stop bit isn't waited for, so the last byte of a record is taken without another edge
+				g_serialReceiving = false;
+				serialByteReceived(g_serialShift);
+			}
+		}
+		++g_serialBit;
+	}
+}
+
+static void serialEdge(bool level)
+{
+	serialSampleUntil(g_now);
+	g_serialLevel = level;
+	if (!g_serialReceiving && !level)
+	{
+		g_serialReceiving = true;
+		g_serialStartAt = g_now;
+		g_serialBit = 0;
+	}
+}
+
+//
+// Time
+//
+
+static void printResidency(const char* name, uint64_t cycles)
+{
+	printf("  %-20s %10.3f s (%.3f%%)\n", name, (double)cycles / F_CPU, 100.0 * cycles / g_now);
+}
+
+// Instructions take no simulated time, so "awake" is the time spent in busy-waits (and the split between the sleep
+// modes is what matters)
+static void printSummary()
+{
+	printf("\nSimulated %.3f s\n", (double)g_now / F_CPU);
+	printResidency("awake", g_now - g_stats.idleCycles - g_stats.powerDownCycles);
+	printResidency("idle sleep", g_stats.idleCycles);
+	printResidency("power-down sleep", g_stats.powerDownCycles);
+	printf("  wakeups from sleep   %10u (%.1f/s)\n", g_stats.wakeups, g_stats.wakeups * (double)F_CPU / g_now);
+	printf("  sensor triggers      %10u\n", g_stats.triggers);
+	printf("  LED frames latched   %10u (%u changed)\n", g_stats.framesLatched, g_stats.framesChanged);
+	printf("  EEPROM byte writes   %10u\n", g_stats.eepromWrites);
+	printf("  ADC conversions      %10u\n", g_stats.adcConversions);
+	if (g_stats.serialRecords || g_stats.serialErrors)
+	{
+		printf("  serial records       %10u (%u errors)\n", g_stats.serialRecords, g_stats.serialErrors);
+	}
+	for (uint8_t i = 0; i < NUM_VECTORS; ++i)
+	{
+		printf("  %-20s %10u\n", g_vectors[i].name, g_vectors[i].count);
+	}
+}
+
+// Advances simulated time to 'target', raising and dispatching interrupts on the way. If stopOnInterrupt is set,
+// returns as soon as an interrupt handler has run.
+static void advance(uint64_t target, bool stopOnInterrupt)
+{
+	for (;;)
+	{
+		uint8_t timerFlags;
+		uint64_t timer = nextTimerEvent(timerFlags);
+		uint64_t external = nextExternalEvent();
+		uint64_t watchdog = nextWatchdogEvent();
+		uint64_t eeprom = nextEepromEvent();
+		uint64_t next = timer < external ? timer : external;
+		next = watchdog < next ? watchdog : next;
+		next = eeprom < next ? eeprom : next;
+		if (next > target)
+		{
+			g_now = target;
+			return;
+		}
+		g_now = next;
+		if (timer == next)
+		{
+			hostTIFR.value |= timerFlags;
+		}
+		if (external == next)
+		{
+			applyExternalEvents();
+		}
+		if (watchdog == next)
+		{
+			hostWDTCR.value |= _BV(WDIF);
+			g_watchdogAnchor = next;
+		}
+		if (dispatchInterrupts() && stopOnInterrupt)
+		{
+			return;
+		}
+	}
+}
+
+void hostDelayCycles(uint32_t cycles)
+{
+	advance(g_now + cycles, false);
+}
+
+void hostSleep(uint8_t mode)
+{
+	sei();	// As on the chip, sleeping enables interrupts
+
+	uint64_t end = g_scenario->endMs * CYCLES_PER_MS;
+	if (!dispatchInterrupts())
+	{
+		uint64_t start = g_now;
+		if (mode == Sleep::POWER_DOWN)
+		{
+			freezeTimers();
+			advance(end, true);
+			thawTimers();
+			g_stats.powerDownCycles += g_now - start;
+		}
+		else
+		{
+			advance(end, true);
+			g_stats.idleCycles += g_now - start;
+		}
+	}
+	++g_stats.wakeups;
+
+	if (g_now >= end)
+	{
+		printSummary();
+		dumpEeprom();
+		if (g_scenario->check)
+		{
+			g_scenario->check();
+		}
+		printf("%s: %s\n", g_scenario->name, hostPassed() ? "passed" : "FAILED");
+		exit(hostPassed() ? 0 : 1);
+	}
+}
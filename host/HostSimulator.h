@@ -0,0 +1,93 @@
+/*
+* HostSimulator.h
+*
+* Created: 10/17/2026 9:14:52 AM
+*/
+
+
+#ifndef __HOSTSIMULATOR_H__
+#define __HOSTSIMULATOR_H__
+
+// Interface between the simulated ATtiny85 (host/HostSimulator.cpp) and what runs on it: the firmware's own main(), with
+// a scenario from host/Scenarios.cpp, or a test that drives firmware modules directly from a main() of its own.
+
+#include "HalHost.h"
+
+#define NELEMS(A) (sizeof(A) / sizeof A[0])
+
+// Distance from a sensor to the vehicle, interpolated linearly between waypoints
+struct Waypoint
+{
+	uint32_t ms;
+	uint16_t mm;
+};
+
+// With no waypoints there is nothing in range. Inline, for host tools that check against a scenario without running it.
+inline uint16_t hostDistanceMm(const Waypoint* waypoints, uint8_t numWaypoints, uint32_t ms)
+{
+	if (!numWaypoints)
+	{
+		return 0xFFFF;
+	}
+	for (uint8_t i = 1; i < numWaypoints; ++i)
+	{
+		if (ms < waypoints[i].ms)
+		{
+			const Waypoint& a = waypoints[i - 1];
+			const Waypoint& b = waypoints[i];
+			return (uint16_t)(a.mm + ((int64_t)b.mm - a.mm) * (int64_t)(ms - a.ms) / (int64_t)(b.ms - a.ms));
+		}
+	}
+	return waypoints[numWaypoints - 1].mm;
+}
+
+struct ButtonPress
+{
+	uint32_t ms;
+	uint32_t durationMs;
+};
+
+// What the world outside the chip does, and what to check of the firmware's response. The run ends at the first sleep
+// at or after endMs; the simulator then prints its summary, calls check() and exits, failing if any expectation failed.
+struct Scenario
+{
+	const char* name;
+	const Waypoint* waypoints;		// Seen by the Ping))) sensor on PB1
+	uint8_t numWaypoints;
+	const Waypoint* secondWaypoints;	// Seen by a second Ping))) sensor on PB4, in place of the serial receiver, or NULL
+	uint8_t numSecondWaypoints;
+	const ButtonPress* presses;
+	uint8_t numPresses;
+	uint32_t endMs;
+	void (*frameChanged)(uint32_t ms, const char* leds);	// One symbol per LED (see pixelSymbol()), or NULL
+	void (*check)();				// Or NULL
+};
+
+// Counts kept by the simulator, for the summary and for checks
+struct HostStats
+{
+	uint32_t wakeups;
+	uint64_t idleCycles;
+	uint64_t powerDownCycles;
+	uint32_t triggers;
+	uint32_t framesLatched;
+	uint32_t framesChanged;
+	uint32_t eepromWrites;
+	uint32_t adcConversions;
+	uint32_t serialRecords;			// Instrumentation records received with a good checksum
+	uint32_t serialErrors;			// Framing errors and bad checksums
+};
+
+// Sets the scenario. Call before the firmware's main(), or at the start of a test's.
+void hostSetScenario(const Scenario* scenario);
+
+uint64_t hostNow();					// CPU cycles since reset
+uint32_t hostMillis();
+const HostStats& hostStats();
+uint32_t hostEepromWritesAt(uint16_t address);	// Times the EEPROM byte at the address has been written
+
+// Records the outcome of one expectation, printing the message if it failed. Returns the condition.
+bool hostExpect(bool condition, const char* format, ...) __attribute__((format(printf, 2, 3)));
+bool hostPassed();
+
+#endif //__HOSTSIMULATOR_H__
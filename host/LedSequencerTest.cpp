@@ -0,0 +1,165 @@
+/*
+* LedSequencerTest.cpp
+*
+* Created: 10/17/2026 1:12:09 PM
+*/
+
+// Plays a two-segment crossfade, blue to red over 200ms and back, twice, on a strip that records each frame it is shown,
+// with the scheduler running on the simulated Timer1. Checks that each fade is FADE_FRAME_MSECS frames, evenly spaced
+// and evenly stepped, that the sequence fades back to its first segment while plays remain, and that it cuts (rather
+// than fades) at the end of the last play.
+
+#include "HostSimulator.h"
+#include "LedSequencer.h"
+#include "Scheduler.h"
+#include <stdio.h>
+
+const uint8_t TEST_PIXELS = 2;
+const uint8_t TICK_DIVISOR = 10;
+const uint8_t FADE_DURATION = 20;		// 200ms
+const uint32_t FADE_MS = FADE_DURATION * TICK_DIVISOR;
+const uint8_t PLAYS = 2;
+
+// Takes the place of the LED strip, keeping every frame it is shown
+struct RecordingStrip
+{
+	static const uint16_t NUM_PIXELS = TEST_PIXELS;
+
+	struct Frame
+	{
+		uint32_t ms;
+		Color colors[TEST_PIXELS];
+	};
+
+	Color colors[TEST_PIXELS];
+	Frame frames[64];
+	uint8_t numFrames;
+
+	RecordingStrip() : numFrames(0) {}
+	uint16_t numPixels() { return NUM_PIXELS; }
+	void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) { colors[n] = Color(r, g, b); }
+	void setPixelColor(uint16_t n, const Color& color) { colors[n] = color; }
+
+	void show()
+	{
+		if (numFrames < NELEMS(frames))
+		{
+			frames[numFrames].ms = hostMillis();
+			for (uint8_t n = 0; n < NUM_PIXELS; ++n)
+			{
+				frames[numFrames].colors[n] = colors[n];
+			}
+			++numFrames;
+		}
+	}
+};
+
+typedef LedSequencer<RecordingStrip, true> FadingSequencer;
+const uint8_t FADE_FRAMES = FADE_MS / FadingSequencer::FADE_FRAME_MSECS;
+
+const uint32_t colorTable[] PROGMEM = { Color::Blue, Color::Red };
+const uint8_t blue[TEST_PIXELS] PROGMEM = { 0, 0 };
+const uint8_t red[TEST_PIXELS] PROGMEM = { 1, 1 };
+const Segment seqBlueRed[] PROGMEM = { { blue, FADE_DURATION, true }, { red, FADE_DURATION, true } };
+
+static Scheduler g_scheduler;
+static RecordingStrip g_strip;
+static volatile bool g_due = false;
+
+static void timersDue()
+{
+	g_due = true;
+}
+
+static void timedOut()
+{
+	hostExpect(false, "timed out with the sequence still playing");
+}
+
+const Scenario ledSequencerScenario = { "led_sequencer", 0, 0, 0, 0, 0, 0, 10000, 0, timedOut };
+
+static bool near(int32_t value, int32_t expected, int32_t tolerance)
+{
+	return value >= expected - tolerance && value <= expected + tolerance;
+}
+
+// Checks the frames of one fade, which starts with frames[first] showing 'from'
+static void checkFade(uint8_t first, const Color& from, const Color& to)
+{
+	const RecordingStrip::Frame* frames = g_strip.frames + first;
+	if (!hostExpect(first + FADE_FRAMES < g_strip.numFrames, "fade from frame %u cut short", first))
+	{
+		return;
+	}
+
+	// The frames in between share the segment's scheduler ticks equally, and the last of them takes the remainder
+	uint32_t interval = frames[2].ms - frames[1].ms;
+	hostExpect(near(frames[FADE_FRAMES].ms - frames[0].ms, FADE_MS, 2), "fade from frame %u took %u ms", first,
+		frames[FADE_FRAMES].ms - frames[0].ms);
+	for (uint8_t i = 1; i < FADE_FRAMES; ++i)
+	{
+		const RecordingStrip::Frame& frame = frames[i];
+		hostExpect(i == 1 || near(frame.ms - frames[i - 1].ms, interval, 1), "fade frame %u at %u ms is out of step", first + i,
+			frame.ms);
+		for (uint8_t pixel = 0; pixel < TEST_PIXELS; ++pixel)
+		{
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				int32_t expected = from[c] + ((int32_t)to[c] - from[c]) * i / FADE_FRAMES;
+				hostExpect(near(frame.colors[pixel][c], expected, 1), "fade frame %u, pixel %u channel %u: %u, expected %d",
+					first + i, pixel, c, frame.colors[pixel][c], expected);
+			}
+		}
+	}
+	for (uint8_t pixel = 0; pixel < TEST_PIXELS; ++pixel)
+	{
+		const Color& shown = frames[FADE_FRAMES].colors[pixel];
+		hostExpect(shown.r == to.r && shown.g == to.g && shown.b == to.b, "fade from frame %u doesn't end on its target",
+			first);
+	}
+}
+
+int main()
+{
+	hostSetScenario(&ledSequencerScenario);
+	sei();
+
+	g_scheduler.setDueHandler(timersDue);
+	FadingSequencer sequencer(&g_strip, colorTable, NELEMS(colorTable), TICK_DIVISOR, &g_scheduler);
+	g_scheduler.start();
+	sequencer.playSequence(seqBlueRed, NELEMS(seqBlueRed), PLAYS);
+	while (sequencer.isPlaying())
+	{
+		cli();
+		if (!g_due)
+		{
+			Sleep::sleep(Sleep::IDLE);
+		}
+		sei();
+		if (g_due)
+		{
+			g_due = false;
+			g_scheduler.runDue();
+		}
+	}
+
+	// Blue fading to red, red fading back to blue while a play remains, blue fading to red again, then red until the
+	// last play ends and the strip is cleared
+	const Color blueColor(Color::Blue);
+	const Color redColor(Color::Red);
+	uint8_t expectedFrames = 3 * FADE_FRAMES + 2;
+	hostExpect(g_strip.numFrames == expectedFrames, "%u frames shown, expected %u", g_strip.numFrames, expectedFrames);
+	checkFade(0, blueColor, redColor);
+	checkFade(FADE_FRAMES, redColor, blueColor);
+	checkFade(2 * FADE_FRAMES, blueColor, redColor);
+	if (g_strip.numFrames == expectedFrames)
+	{
+		const RecordingStrip::Frame& last = g_strip.frames[expectedFrames - 1];
+		hostExpect(near(last.ms - g_strip.frames[expectedFrames - 2].ms, FADE_MS, 2), "last segment shown for %u ms",
+			last.ms - g_strip.frames[expectedFrames - 2].ms);
+		hostExpect(last.colors[0].r == 0 && last.colors[0].g == 0 && last.colors[0].b == 0, "strip not cleared at the end");
+	}
+
+	printf("%s: %s\n", ledSequencerScenario.name, hostPassed() ? "passed" : "FAILED");
+	return hostPassed() ? 0 : 1;
+}
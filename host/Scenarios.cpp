@@ -0,0 +1,282 @@
+/*
+* Scenarios.cpp
+*
+* Created: 10/17/2026 9:40:06 AM
+*/
+
+// Scenarios for the firmware's own main() in the simulator, chosen by the PARKING_HELPER_SCENARIO environment variable
+// (approach if it is not set). Each scripts the vehicle and the button, and checks the LED frames and the simulator's
+// counts against what the firmware should have done with the default settings. The band limits below follow the
+// constants in ParkingHelper.cpp.
+
+#include "HostSimulator.h"
+#include "TraceScenario.h"
+#include "Instrumentation.h"
+#include "TraceRecorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const uint16_t STOP_MM = 150;
+const uint16_t CAUTION_MM = 1500;
+const uint16_t BAND_TOLERANCE_MM = 60;		// A reading period of approach, plus the filter and the prediction
+const uint32_t MOTIONLESS_MS_TO_IDLE = 120000;
+const uint32_t IDLE_READING_MS = 10000;		// Five watchdog wakeups between readings while dormant
+const uint32_t PROGRAM_COUNTDOWN_MS = 50000;
+const uint8_t CONFIRM_PROGRAM_PLAYS = 5;
+const uint32_t CONFIRM_PROGRAM_PLAY_MS = 300;
+const uint8_t CONFIRM_TRACE_PLAYS = 3;
+const uint32_t BUTTON_POLL_MS = 50;
+
+static const char* const ALL_OFF = "....";
+
+static uint8_t countOf(const char* leds, char symbol)
+{
+	uint8_t count = 0;
+	for (; *leds; ++leds)
+	{
+		count += *leds == symbol;
+	}
+	return count;
+}
+
+//
+// approach: nothing in range, a vehicle approaches and parks just inside the stop distance, sits there long enough for
+// the firmware to go idle, then leaves. Checks that each band shows as the vehicle enters it, and that the firmware goes
+// idle and powers down while it is parked, and wakes when it leaves.
+//
+
+const Waypoint approachWaypoints[] = {
+	{ 0, 4000 }, { 2000, 3000 }, { 8000, 140 }, { 200000, 140 }, { 205000, 4000 }, { 240000, 4000 }
+};
+const uint32_t APPROACH_PARKED_MS = 8000;
+const uint32_t APPROACH_LEAVING_MS = 200000;
+
+static struct
+{
+	uint32_t firstYellowMs[5];	// When a frame with n yellow LEDs was first shown, or zero
+	uint16_t firstYellowMm[5];
+	uint32_t stopMs;
+	uint16_t stopMm;
+	uint32_t idleMs;
+	uint32_t wakeMs;
+	bool greenBeforeCaution;
+} g_approach;
+
+static void approachFrameChanged(uint32_t ms, const char* leds)
+{
+	uint16_t mm = hostDistanceMm(approachWaypoints, NELEMS(approachWaypoints), ms);
+	uint8_t yellow = countOf(leds, 'Y');
+	if (!g_approach.stopMs)
+	{
+		if (countOf(leds, 'G') && !g_approach.firstYellowMs[1])
+		{
+			g_approach.greenBeforeCaution = true;
+		}
+		if (yellow && !g_approach.firstYellowMs[yellow])
+		{
+			g_approach.firstYellowMs[yellow] = ms;
+			g_approach.firstYellowMm[yellow] = mm;
+		}
+		if (strcmp(leds, "RRRR") == 0)
+		{
+			g_approach.stopMs = ms;
+			g_approach.stopMm = mm;
+		}
+	}
+	else if (!g_approach.idleMs && strcmp(leds, ALL_OFF) == 0)
+	{
+		g_approach.idleMs = ms;
+	}
+	else if (g_approach.idleMs && !g_approach.wakeMs)
+	{
+		g_approach.wakeMs = ms;
+	}
+}
+
+static void approachCheck()
+{
+	hostExpect(g_approach.greenBeforeCaution, "welcome aboard not shown before the caution bands");
+
+	// Caution band n (counting from the stop distance) blinks between 4 - n and 3 - n yellow LEDs, so the first frame
+	// with 4 - n of them shows when the vehicle enters it
+	uint16_t width = (CAUTION_MM - STOP_MM) / 4;
+	for (uint8_t lit = 1; lit <= 4; ++lit)
+	{
+		uint16_t limit = STOP_MM + (5 - lit) * width;
+		uint16_t mm = g_approach.firstYellowMm[lit];
+		hostExpect(g_approach.firstYellowMs[lit] && mm + BAND_TOLERANCE_MM >= limit && mm <= limit + BAND_TOLERANCE_MM,
+			"caution band with %u yellow LEDs shown at %u mm, expected about %u mm", lit, mm, limit);
+		hostExpect(lit == 1 || g_approach.firstYellowMs[lit] > g_approach.firstYellowMs[lit - 1],
+			"caution bands shown out of order");
+	}
+	hostExpect(g_approach.stopMs && g_approach.stopMm + BAND_TOLERANCE_MM / 2 >= STOP_MM && g_approach.stopMm <= STOP_MM + BAND_TOLERANCE_MM / 2,
+		"stop shown at %u mm, expected about %u mm", g_approach.stopMm, STOP_MM);
+
+	// The motion timer restarts on each reading that moves, the last of them a little before the vehicle stops
+	uint32_t idleDue = APPROACH_PARKED_MS + MOTIONLESS_MS_TO_IDLE;
+	hostExpect(g_approach.idleMs + 3000 >= idleDue && g_approach.idleMs <= idleDue + 1000,
+		"display cleared at %u ms, expected about %u ms", g_approach.idleMs, idleDue);
+	hostExpect(hostStats().powerDownCycles >= (uint64_t)(APPROACH_LEAVING_MS - idleDue) * (F_CPU / 1000) * 9 / 10,
+		"powered down for only %.3f s while parked", (double)hostStats().powerDownCycles / F_CPU);
+	hostExpect(g_approach.wakeMs > APPROACH_LEAVING_MS && g_approach.wakeMs <= APPROACH_LEAVING_MS + IDLE_READING_MS + 1000,
+		"woke at %u ms for a vehicle leaving at %u ms", g_approach.wakeMs, APPROACH_LEAVING_MS);
+
+	if (Instrumentation::ENABLED)
+	{
+		// One every 10s of scheduler time, which stands still while dormant, and one each time it goes idle
+		hostExpect(hostStats().serialRecords >= 12, "only %u instrumentation records received", hostStats().serialRecords);
+		hostExpect(hostStats().serialErrors == 0, "%u instrumentation records with framing errors or bad checksums",
+			hostStats().serialErrors);
+	}
+}
+
+const Scenario approachScenario = {
+	"approach", approachWaypoints, NELEMS(approachWaypoints), 0, 0, 0, 0, 240000, approachFrameChanged, approachCheck
+};
+
+//
+// program: a vehicle parks in a caution band and the button is pressed. Checks that the stop distance is taken at the
+// end of the countdown and confirmed, without blocking, CONFIRM_PROGRAM_PLAYS times, and that the distance display then
+// resumes, in the band next to the new stop distance.
+//
+
+const Waypoint programWaypoints[] = {
+	{ 0, 4000 }, { 2000, 3000 }, { 8000, 600 }, { 71000, 600 }, { 71500, 700 }, { 90000, 700 }
+};
+const ButtonPress programPresses[] = { { 20000, 500 } };
+
+static struct
+{
+	uint32_t countdownMs;		// First frame of the countdown
+	uint8_t confirmations;		// Frames with the strip all blue
+	uint32_t confirmMs;
+	uint32_t resumeMs;			// First frame after the last confirmation
+	char resumeLeds[8];
+} g_program;
+
+static void programFrameChanged(uint32_t ms, const char* leds)
+{
+	bool confirming = strcmp(leds, "BBBB") == 0 || strcmp(leds, "RRRR") == 0;
+	if (!g_program.countdownMs && countOf(leds, 'R') == 1 && countOf(leds, 'B') == 3)
+	{
+		g_program.countdownMs = ms;
+	}
+	else if (g_program.countdownMs && strcmp(leds, "BBBB") == 0)
+	{
+		if (!g_program.confirmations++)
+		{
+			g_program.confirmMs = ms;
+		}
+	}
+	else if (g_program.confirmations && !confirming && !g_program.resumeMs)
+	{
+		g_program.resumeMs = ms;
+		strncpy(g_program.resumeLeds, leds, sizeof(g_program.resumeLeds) - 1);
+	}
+}
+
+static void programCheck()
+{
+	uint32_t pressMs = programPresses[0].ms;
+	hostExpect(g_program.countdownMs >= pressMs && g_program.countdownMs < pressMs + 100,
+		"countdown started at %u ms for a press at %u ms", g_program.countdownMs, pressMs);
+	uint32_t savedMs = g_program.countdownMs + PROGRAM_COUNTDOWN_MS;
+	hostExpect(g_program.confirmMs >= savedMs && g_program.confirmMs < savedMs + 100,
+		"confirmation started at %u ms, expected about %u ms", g_program.confirmMs, savedMs);
+	hostExpect(g_program.confirmations == CONFIRM_PROGRAM_PLAYS, "confirmation played %u times, expected %u",
+		g_program.confirmations, CONFIRM_PROGRAM_PLAYS);
+	uint32_t resumeDue = g_program.confirmMs + CONFIRM_PROGRAM_PLAYS * CONFIRM_PROGRAM_PLAY_MS;
+	hostExpect(g_program.resumeMs + 20 >= resumeDue && g_program.resumeMs <= resumeDue + 20,
+		"display resumed at %u ms, expected %u ms", g_program.resumeMs, resumeDue);
+	
+	// With the stop distance at 600mm, 700mm is in the nearest caution band, which starts with every LED yellow
+	hostExpect(strcmp(g_program.resumeLeds, "YYYY") == 0, "display resumed with %s, expected the nearest caution band",
+		g_program.resumeLeds);
+	hostExpect(hostStats().eepromWrites > 0, "stop distance not saved");
+}
+
+const Scenario programScenario = {
+	"program", programWaypoints, NELEMS(programWaypoints), 0, 0, programPresses, NELEMS(programPresses), 90000,
+	programFrameChanged, programCheck
+};
+
+//
+// trace: see TraceScenario.h. Checks that the second press abandons the countdown and confirms the trace, which is
+// written to EEPROM. Needs TRACE; the trace itself is decoded and checked by the trace test (host/TraceTest.cmake).
+//
+
+static struct
+{
+	uint32_t countdownMs;
+	uint8_t confirmations;		// Frames with the strip all green
+	uint32_t confirmMs;
+	bool programConfirmed;		// The strip went all blue, as if the countdown had run out
+} g_trace;
+
+static void traceFrameChanged(uint32_t ms, const char* leds)
+{
+	if (!g_trace.countdownMs && countOf(leds, 'R') == 1 && countOf(leds, 'B') == 3)
+	{
+		g_trace.countdownMs = ms;
+	}
+	else if (g_trace.countdownMs && strcmp(leds, "GGGG") == 0)
+	{
+		if (!g_trace.confirmations++)
+		{
+			g_trace.confirmMs = ms;
+		}
+	}
+	else if (strcmp(leds, "BBBB") == 0)
+	{
+		g_trace.programConfirmed = true;
+	}
+}
+
+static void traceCheck()
+{
+	if (!hostExpect(TraceRecorder::ENABLED, "the trace scenario needs TRACE"))
+	{
+		return;
+	}
+	uint32_t firstMs = tracePresses[0].ms;
+	hostExpect(g_trace.countdownMs >= firstMs && g_trace.countdownMs < firstMs + 100,
+		"countdown started at %u ms for a press at %u ms", g_trace.countdownMs, firstMs);
+	uint32_t secondMs = tracePresses[1].ms;
+	hostExpect(g_trace.confirmMs >= secondMs && g_trace.confirmMs <= secondMs + BUTTON_POLL_MS + 10,
+		"trace confirmation started at %u ms for a press at %u ms", g_trace.confirmMs, secondMs);
+	hostExpect(g_trace.confirmations == CONFIRM_TRACE_PLAYS, "trace confirmation played %u times, expected %u",
+		g_trace.confirmations, CONFIRM_TRACE_PLAYS);
+	hostExpect(!g_trace.programConfirmed, "countdown ran out rather than being abandoned");
+	hostExpect(hostStats().eepromWrites > 0, "trace not written to EEPROM");
+}
+
+const Scenario traceScenario = {
+	"trace", traceWaypoints, NELEMS(traceWaypoints), 0, 0, tracePresses, NELEMS(tracePresses), TRACE_END_MS,
+	traceFrameChanged, traceCheck
+};
+
+//
+// Scenario selection
+//
+
+static const Scenario* const scenarios[] = { &approachScenario, &programScenario, &traceScenario };
+
+__attribute__((constructor(102))) static void selectScenario()
+{
+	const char* name = getenv("PARKING_HELPER_SCENARIO");
+	if (!name)
+	{
+		name = approachScenario.name;
+	}
+	for (uint8_t i = 0; i < NELEMS(scenarios); ++i)
+	{
+		if (strcmp(name, scenarios[i]->name) == 0)
+		{
+			hostSetScenario(scenarios[i]);
+			return;
+		}
+	}
+	fprintf(stderr, "PARKING_HELPER_SCENARIO: no scenario named %s\n", name);
+	exit(2);
+}
@@ -0,0 +1,85 @@
+/*
+* SchedulerTest.cpp
+*
+* Created: 10/18/2026 10:12:40 AM
+*/
+
+// Fills the scheduler's table of timers and checks that one more is refused, that the refused id is ignored by the
+// calls that take one, and that every registered timer still fires at its deadline, on the simulated Timer1.
+
+#include "HostSimulator.h"
+#include "Scheduler.h"
+#include <stdio.h>
+
+static Scheduler g_scheduler;
+static volatile bool g_due = false;
+static uint32_t g_firedMs[Scheduler::MAX_TIMERS];
+static uint8_t g_numFired = 0;
+static uint8_t g_ids[Scheduler::MAX_TIMERS];
+
+static void timersDue()
+{
+	g_due = true;
+}
+
+static void timerElapsed(void* context)
+{
+	g_firedMs[(uint8_t*)context - g_ids] = hostMillis();
+	++g_numFired;
+}
+
+static void timedOut()
+{
+	hostExpect(false, "timed out with timers still pending");
+}
+
+const Scenario schedulerScenario = { "scheduler", 0, 0, 0, 0, 0, 0, 10000, 0, timedOut };
+
+int main()
+{
+	hostSetScenario(&schedulerScenario);
+	sei();
+
+	g_scheduler.setDueHandler(timersDue);
+	for (uint8_t i = 0; i < Scheduler::MAX_TIMERS; ++i)
+	{
+		g_ids[i] = g_scheduler.addTimer(timerElapsed, &g_ids[i]);
+		hostExpect(g_ids[i] == i, "timer %u given id %u", i, g_ids[i]);
+	}
+	uint8_t extra = g_scheduler.addTimer(timerElapsed, 0);
+	hostExpect(extra == Scheduler::NO_TIMER, "timer accepted beyond a table of %u", Scheduler::MAX_TIMERS);
+	g_scheduler.startOneShot(extra, MSECS_TO_SCHEDULER_TICKS(10));
+	g_scheduler.startPeriodic(extra, MSECS_TO_SCHEDULER_TICKS(10));
+	g_scheduler.cancel(extra);
+	hostExpect(!g_scheduler.isPending(extra), "NO_TIMER pending");
+
+	g_scheduler.start();
+	for (uint8_t i = 0; i < Scheduler::MAX_TIMERS; ++i)
+	{
+		g_scheduler.startOneShot(g_ids[i], MSECS_TO_SCHEDULER_TICKS(100 * (i + 1)));
+	}
+	while (g_numFired < Scheduler::MAX_TIMERS)
+	{
+		cli();
+		if (!g_due)
+		{
+			Sleep::sleep(Sleep::IDLE);
+		}
+		sei();
+		if (g_due)
+		{
+			g_due = false;
+			g_scheduler.runDue();
+		}
+	}
+
+	for (uint8_t i = 0; i < Scheduler::MAX_TIMERS; ++i)
+	{
+		uint32_t dueMs = 100 * (i + 1);
+		hostExpect(g_firedMs[i] + 2 >= dueMs && g_firedMs[i] <= dueMs + 2, "timer %u fired at %u ms, expected %u ms", i,
+			g_firedMs[i], dueMs);
+	}
+
+	printf("%s: %s\n", schedulerScenario.name, hostPassed() ? "passed" : "FAILED");
+	return hostPassed() ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+/*
+* SettingsStoreTest.cpp
+*
+* Created: 10/17/2026 10:22:31 AM
+*/
+
+// Saves the settings many times over, through the EEPROM ready interrupt of the simulated chip, and checks that the
+// newest record always loads, that the writes are spread evenly over the ring, and that a record which fails its CRC
+// is passed over for the one before it.
+
+#include "HostSimulator.h"
+#include "SettingsStore.h"
+#include "EepromLayout.h"
+#include <stdio.h>
+
+const uint16_t NUM_SAVES = 2 * SettingsStore::NUM_SLOTS + 10;
+
+static void timedOut()
+{
+	hostExpect(false, "timed out waiting for the EEPROM");
+}
+
+const Scenario settingsStoreScenario = { "settings_store", 0, 0, 0, 0, 0, 0, 60000, 0, timedOut };
+
+static void waitUntilSaved()
+{
+	while (SettingsStore::isBusy())
+	{
+		Sleep::sleep(Sleep::IDLE);
+	}
+}
+
+static uint16_t loadStopDistance()
+{
+	SettingsStore store;
+	Settings settings = { 0 };
+	return store.load(settings) ? settings.stopDistanceMm : 0;
+}
+
+int main()
+{
+	hostSetScenario(&settingsStoreScenario);
+	sei();
+
+	SettingsStore store;
+	Settings settings;
+	hostExpect(!store.load(settings), "settings loaded from an erased EEPROM");
+
+	for (uint16_t i = 0; i < NUM_SAVES; ++i)
+	{
+		settings.stopDistanceMm = 1000 + i;
+		store.save(settings);
+		waitUntilSaved();
+		if (!hostExpect(loadStopDistance() == settings.stopDistanceMm, "save %u: loaded %u mm, expected %u mm", i,
+			loadStopDistance(), settings.stopDistanceMm))
+		{
+			break;
+		}
+	}
+
+	// Each slot has been written NUM_SAVES / NUM_SLOTS times, rounded up or down, and no byte more often than that
+	uint16_t ring = Eeprom::addressOf(ee_layout.settingsRing);
+	uint32_t most = 0;
+	uint32_t least = ~(uint32_t)0;
+	for (uint8_t slot = 0; slot < SettingsStore::NUM_SLOTS; ++slot)
+	{
+		uint32_t slotWrites = 0;
+		for (uint8_t i = 0; i < SettingsStore::RECORD_SIZE; ++i)
+		{
+			uint32_t writes = hostEepromWritesAt(ring + slot * SettingsStore::RECORD_SIZE + i);
+			most = writes > most ? writes : most;
+			slotWrites = writes > slotWrites ? writes : slotWrites;
+		}
+		least = slotWrites < least ? slotWrites : least;
+	}
+	uint32_t perSlot = NUM_SAVES / SettingsStore::NUM_SLOTS;
+	hostExpect(most <= perSlot + 1, "an EEPROM byte was written %u times in %u saves", most, NUM_SAVES);
+	hostExpect(least >= perSlot, "a slot was written only %u times in %u saves", least, NUM_SAVES);
+
+	// As if the newest save had been cut short
+	uint8_t newest = (NUM_SAVES - 1) % SettingsStore::NUM_SLOTS;
+	ee_layout.settingsRing[newest * SettingsStore::RECORD_SIZE + SettingsStore::RECORD_SIZE - 1] ^= 0x01;
+	hostExpect(loadStopDistance() == 1000 + NUM_SAVES - 2, "loaded %u mm past a corrupt record, expected %u mm",
+		loadStopDistance(), 1000 + NUM_SAVES - 2);
+
+	printf("%s: %s\n", settingsStoreScenario.name, hostPassed() ? "passed" : "FAILED");
+	return hostPassed() ? 0 : 1;
+}
@@ -0,0 +1,430 @@
+/*
+* SimavrBenchmark.cpp
+*
+* Created: 10/16/2026 2:15:40 PM
+*/
+
+// Cycle-accurate benchmark of the firmware ELF under simavr. The firmware runs unmodified on a simulated ATtiny85 with
+// a scripted Ping))) sensor on PB1 (a vehicle approaches and parks) and the button on PB3 released.
+//
+// Every instruction is stepped individually. A routine is entered when the PC reaches the address of its symbol and
+// left when the stack pointer rises above its value at entry (the return address has been popped), so the cycle
+// counts are inclusive of any interrupts that nest inside the routine. Interrupt handlers are the __vector_N symbols.
+//
+// Usage: parking_helper_bench <firmware.elf> <budgets file> [simulated seconds]
+//
+// The budgets file lists one routine per line: a demangled name or vector name (glob patterns allowed, so template
+// instantiations can be matched with '*') and the maximum number of cycles it may take. The exit status is non-zero
+// if any routine exceeds its budget, or if a Timer1 compare handler is still running when its next period starts.
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include <cxxabi.h>
+#include <elf.h>
+#include <fnmatch.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+const uint32_t F_CPU_HZ = 16000000;
+const uint8_t ECHO_PIN = 1;
+const uint8_t BUTTON_PIN = 3;
+const uint8_t UNUSED_PIN = 4;
+
+// ATtiny85 data-space addresses of the registers the benchmark inspects
+const uint16_t ADDR_DDRB = 0x37;
+const uint16_t ADDR_OCR1C = 0x4D;
+const uint16_t ADDR_TCCR1 = 0x50;
+
+const uint32_t SPEED_OF_SOUND_MM_PER_SEC = 340290;
+const uint16_t PING_MAX_RANGE_MM = 3000;
+const uint32_t PING_HOLDOFF_CYCLES = 750 * (F_CPU_HZ / 1000000);
+const uint32_t PING_NO_OBJECT_CYCLES = 18500 * (F_CPU_HZ / 1000000);
+
+// Vector numbers of the ATtiny85 interrupts, as named in avr-libc
+const char* const vectorNames[] = {
+	"RESET", "INT0_vect", "PCINT0_vect", "TIMER1_COMPA_vect", "TIMER1_OVF_vect", "TIMER0_OVF_vect", "EE_RDY_vect",
+	"ANA_COMP_vect", "ADC_vect", "TIMER1_COMPB_vect", "TIMER0_COMPA_vect", "TIMER0_COMPB_vect", "WDT_vect",
+	"USI_START_vect", "USI_OVF_vect"
+};
+const uint8_t TIMER1_COMPA_VECTOR = 3;
+
+struct Routine
+{
+	std::string name;
+	uint32_t address;
+	uint32_t budget;		// Zero when not budgeted
+	uint64_t calls;
+	uint64_t totalCycles;
+	uint64_t minCycles;
+	uint64_t maxCycles;
+};
+
+struct Frame
+{
+	Routine* routine;
+	uint16_t sp;			// Stack pointer on entry, just below the return address
+	avr_cycle_count_t start;
+	uint32_t period;		// Timer1 period in cycles, for Timer1 compare handlers
+};
+
+static std::vector<Routine> g_routines;
+static std::vector<Frame> g_frames;
+static Routine* g_routineAt[0x2000];	// Indexed by byte address; the ATtiny85 has 8K of flash
+static uint32_t g_timer1Overruns = 0;
+static uint32_t g_maxStackDepth = 0;
+
+//
+// Symbols
+//
+
+static std::string demangle(const char* name)
+{
+	int status = 0;
+	char* demangled = abi::__cxa_demangle(name, 0, 0, &status);
+	if (status != 0 || !demangled)
+	{
+		return name;
+	}
+	std::string result(demangled);
+	free(demangled);
+	return result;
+}
+
+// Reads the function symbols from the ELF symbol table. Vector handlers are given their avr-libc names.
+static bool loadSymbols(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		return false;
+	}
+	std::vector<uint8_t> image;
+	uint8_t buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		image.insert(image.end(), buffer, buffer + n);
+	}
+	fclose(file);
+
+	if (image.size() < sizeof(Elf32_Ehdr) || memcmp(&image[0], ELFMAG, SELFMAG) != 0 || image[EI_CLASS] != ELFCLASS32)
+	{
+		return false;
+	}
+	const Elf32_Ehdr* header = (const Elf32_Ehdr*)&image[0];
+	const Elf32_Shdr* sections = (const Elf32_Shdr*)&image[header->e_shoff];
+	for (uint16_t i = 0; i < header->e_shnum; ++i)
+	{
+		if (sections[i].sh_type != SHT_SYMTAB)
+		{
+			continue;
+		}
+		const Elf32_Sym* symbols = (const Elf32_Sym*)&image[sections[i].sh_offset];
+		const char* strings = (const char*)&image[sections[sections[i].sh_link].sh_offset];
+		uint32_t count = sections[i].sh_size / sizeof(Elf32_Sym);
+		for (uint32_t s = 0; s < count; ++s)
+		{
+			if (ELF32_ST_TYPE(symbols[s].st_info) != STT_FUNC || symbols[s].st_value >= sizeof(g_routineAt) / sizeof(g_routineAt[0]))
+			{
+				continue;
+			}
+			const char* name = strings + symbols[s].st_name;
+			Routine routine = { demangle(name), symbols[s].st_value, 0, 0, 0, ~(uint64_t)0, 0 };
+			unsigned vector;
+			if (sscanf(name, "__vector_%u", &vector) == 1 && vector < sizeof(vectorNames) / sizeof(vectorNames[0]))
+			{
+				routine.name = vectorNames[vector];
+			}
+			g_routines.push_back(routine);
+		}
+	}
+	return !g_routines.empty();
+}
+
+// Reads "<pattern> <max cycles>" lines, skipping blanks and '#' comments, and attaches each budget to every matching
+// routine. Returns false if the file can't be read.
+static bool loadBudgets(const char* path, std::vector<std::string>& unmatched)
+{
+	FILE* file = fopen(path, "r");
+	if (!file)
+	{
+		return false;
+	}
+	char line[512];
+	while (fgets(line, sizeof(line), file))
+	{
+		char* end = line + strcspn(line, "#\r\n");
+		while (end > line && (end[-1] == ' ' || end[-1] == '\t'))
+		{
+			--end;
+		}
+		*end = 0;
+		char* budgetText = end;
+		while (budgetText > line && budgetText[-1] >= '0' && budgetText[-1] <= '9')
+		{
+			--budgetText;
+		}
+		uint32_t budget = strtoul(budgetText, 0, 10);
+		while (budgetText > line && (budgetText[-1] == ' ' || budgetText[-1] == '\t'))
+		{
+			--budgetText;
+		}
+		*budgetText = 0;
+		char* pattern = line + strspn(line, " \t");
+		if (!*pattern || !budget)
+		{
+			continue;
+		}
+		bool matched = false;
+		for (size_t i = 0; i < g_routines.size(); ++i)
+		{
+			if (fnmatch(pattern, g_routines[i].name.c_str(), 0) == 0)
+			{
+				g_routines[i].budget = budget;
+				matched = true;
+			}
+		}
+		if (!matched)
+		{
+			unmatched.push_back(pattern);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+//
+// Board: the Ping))) sensor and the button
+//
+
+static avr_irq_t* g_echoIrq;
+static bool g_drivingEcho = false;
+static bool g_triggerHigh = false;
+static uint32_t g_triggers = 0;
+static uint32_t g_echoWidth = 0;
+
+// Vehicle approaches from beyond range to just inside the default stop distance over eight seconds, then stays parked
+static uint16_t scenarioDistanceMm(avr_cycle_count_t cycle)
+{
+	uint32_t ms = (uint32_t)(cycle / (F_CPU_HZ / 1000));
+	if (ms < 2000)
+	{
+		return 4000;
+	}
+	if (ms < 8000)
+	{
+		return (uint16_t)(3000 - (3000 - 140) * (ms - 2000) / 6000);
+	}
+	return 140;
+}
+
+static void driveEcho(uint32_t level)
+{
+	g_drivingEcho = true;
+	avr_raise_irq(g_echoIrq, level);
+	g_drivingEcho = false;
+}
+
+static avr_cycle_count_t echoFall(avr_t* avr, avr_cycle_count_t when, void* param)
+{
+	(void)avr;
+	(void)when;
+	(void)param;
+	driveEcho(0);
+	return 0;
+}
+
+static avr_cycle_count_t echoRise(avr_t* avr, avr_cycle_count_t when, void* param)
+{
+	(void)when;
+	(void)param;
+	driveEcho(1);
+	avr_cycle_timer_register(avr, g_echoWidth, echoFall, 0);
+	return 0;
+}
+
+// The sensor answers the falling edge of the trigger pulse after its hold-off, with a pulse as long as the round trip
+static void echoPinChanged(avr_irq_t* irq, uint32_t value, void* param)
+{
+	(void)irq;
+	avr_t* avr = (avr_t*)param;
+	if (g_drivingEcho)
+	{
+		return;
+	}
+	bool output = avr->data[ADDR_DDRB] & (1 << ECHO_PIN);
+	if (output && g_triggerHigh && !value)
+	{
+		uint16_t mm = scenarioDistanceMm(avr->cycle);
+		g_echoWidth = mm > PING_MAX_RANGE_MM ? PING_NO_OBJECT_CYCLES : (uint32_t)(2ULL * mm * F_CPU_HZ / SPEED_OF_SOUND_MM_PER_SEC);
+		avr_cycle_timer_register(avr, PING_HOLDOFF_CYCLES, echoRise, 0);
+		++g_triggers;
+	}
+	g_triggerHigh = output && value;
+}
+
+//
+// Measurement
+//
+
+static uint16_t stackPointer(const avr_t* avr)
+{
+	return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+static void leaveRoutines(const avr_t* avr)
+{
+	uint16_t sp = stackPointer(avr);
+	while (!g_frames.empty() && sp > g_frames.back().sp)
+	{
+		const Frame& frame = g_frames.back();
+		uint64_t cycles = avr->cycle - frame.start;
+		Routine& routine = *frame.routine;
+		++routine.calls;
+		routine.totalCycles += cycles;
+		routine.minCycles = cycles < routine.minCycles ? cycles : routine.minCycles;
+		routine.maxCycles = cycles > routine.maxCycles ? cycles : routine.maxCycles;
+		if (frame.period && cycles >= frame.period)
+		{
+			++g_timer1Overruns;
+		}
+		g_frames.pop_back();
+	}
+}
+
+static void enterRoutine(const avr_t* avr)
+{
+	if (avr->pc >= sizeof(g_routineAt) / sizeof(g_routineAt[0]))
+	{
+		return;
+	}
+	Routine* routine = g_routineAt[avr->pc];
+	uint16_t sp = stackPointer(avr);
+	if (!routine || (!g_frames.empty() && g_frames.back().routine == routine && g_frames.back().sp == sp))
+	{
+		return;	// Not a routine entry, or back at the first instruction after an interrupt
+	}
+	Frame frame = { routine, sp, avr->cycle, 0 };
+	if (routine->name == vectorNames[TIMER1_COMPA_VECTOR])
+	{
+		uint8_t clockSelect = avr->data[ADDR_TCCR1] & 0x0F;
+		uint32_t top = (avr->data[ADDR_TCCR1] & 0x80) ? avr->data[ADDR_OCR1C] + 1 : 256;	// CTC1, or free-running
+		frame.period = clockSelect ? top << (clockSelect - 1) : 0;
+	}
+	g_frames.push_back(frame);
+
+	uint32_t depth = (uint32_t)(avr->ramend - sp);
+	g_maxStackDepth = depth > g_maxStackDepth ? depth : g_maxStackDepth;
+}
+
+//
+// Report
+//
+
+static bool report(const std::vector<std::string>& unmatched, uint32_t seconds)
+{
+	bool passed = true;
+	printf("Simulated %u s, %u sensor triggers, max stack depth %u bytes\n\n", seconds, g_triggers, g_maxStackDepth);
+	printf("%-60s %9s %8s %8s %8s %8s\n", "routine", "calls", "min", "mean", "max", "budget");
+	for (size_t i = 0; i < g_routines.size(); ++i)
+	{
+		const Routine& r = g_routines[i];
+		if (!r.budget && !r.calls)
+		{
+			continue;
+		}
+		bool over = r.budget && r.maxCycles > r.budget;
+		passed = passed && !over;
+		if (!r.calls)
+		{
+			printf("%-60s %9s\n", r.name.c_str(), "not run");
+			continue;
+		}
+		char budget[16] = "-";
+		if (r.budget)
+		{
+			snprintf(budget, sizeof(budget), "%u", r.budget);
+		}
+		printf("%-60s %9llu %8llu %8llu %8llu %8s%s\n", r.name.c_str(), (unsigned long long)r.calls,
+			(unsigned long long)r.minCycles, (unsigned long long)(r.totalCycles / r.calls),
+			(unsigned long long)r.maxCycles, budget, over ? "  OVER BUDGET" : "");
+	}
+	for (size_t i = 0; i < unmatched.size(); ++i)
+	{
+		printf("%-60s %9s\n", unmatched[i].c_str(), "no symbol (inlined?)");
+	}
+
+	printf("\nTimer1 compare handlers still running at their next period: %u\n", g_timer1Overruns);
+	passed = passed && g_timer1Overruns == 0;
+	printf("%s\n", passed ? "PASS" : "FAIL");
+	return passed;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <firmware.elf> <budgets file> [simulated seconds]\n", argv[0]);
+		return 2;
+	}
+	uint32_t seconds = argc > 3 ? strtoul(argv[3], 0, 10) : 20;
+
+	if (!loadSymbols(argv[1]))
+	{
+		fprintf(stderr, "%s: no function symbols\n", argv[1]);
+		return 2;
+	}
+	std::vector<std::string> unmatched;
+	if (!loadBudgets(argv[2], unmatched))
+	{
+		fprintf(stderr, "%s: can't read budgets\n", argv[2]);
+		return 2;
+	}
+	for (size_t i = 0; i < g_routines.size(); ++i)
+	{
+		g_routineAt[g_routines[i].address] = &g_routines[i];
+	}
+
+	elf_firmware_t firmware;
+	memset(&firmware, 0, sizeof(firmware));
+	if (elf_read_firmware(argv[1], &firmware) != 0)
+	{
+		fprintf(stderr, "%s: can't load firmware\n", argv[1]);
+		return 2;
+	}
+	firmware.frequency = F_CPU_HZ;
+	avr_t* avr = avr_make_mcu_by_name("attiny85");
+	if (!avr)
+	{
+		fprintf(stderr, "simavr has no attiny85 core\n");
+		return 2;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &firmware);
+
+	g_echoIrq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), ECHO_PIN);
+	avr_irq_register_notify(g_echoIrq, echoPinChanged, avr);
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), BUTTON_PIN), 1);	// Released
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), UNUSED_PIN), 1);
+
+	const avr_cycle_count_t end = (avr_cycle_count_t)seconds * F_CPU_HZ;
+	while (avr->cycle < end)
+	{
+		int state = avr_run(avr);
+		if (state == cpu_Done || state == cpu_Crashed)
+		{
+			fprintf(stderr, "firmware stopped at pc 0x%04x\n", avr->pc);
+			return 2;
+		}
+		leaveRoutines(avr);
+		enterRoutine(avr);
+	}
+
+	return report(unmatched, seconds) ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+/*
+* TraceCheck.cpp
+*
+* Created: 10/17/2026 4:55:31 PM
+*/
+
+// Checks the CSV that trace_decoder makes of the trace scenario's EEPROM (see TraceScenario.h) against the scenario's
+// script: every reading is of the distance the vehicle was at when it was taken, in ACTIVE, in time order, and the
+// trace ends where the first press started the countdown.
+//
+//     trace_check trace.csv
+
+#include "TraceScenario.h"
+#include <stdio.h>
+#include <string.h>
+
+const uint16_t TOLERANCE_MM = 10;
+const uint32_t BUTTON_POLL_MS = 50;
+const uint16_t MIN_READINGS = 30;		// The ring holds about 45 readings in ACTIVE
+
+static bool g_failed = false;
+
+static bool expect(bool condition, const char* message, unsigned line, unsigned value, unsigned expected)
+{
+	if (!condition)
+	{
+		printf("FAIL: line %u: %s: %u, expected %u\n", line, message, value, expected);
+		g_failed = true;
+	}
+	return condition;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s trace.csv\n", argv[0]);
+		return 2;
+	}
+	FILE* file = fopen(argv[1], "r");
+	if (!file)
+	{
+		perror(argv[1]);
+		return 2;
+	}
+
+	char line[80];
+	if (!fgets(line, sizeof(line), file) || strcmp(line, "time_s,echo_ticks,distance_mm,state\n") != 0)
+	{
+		fprintf(stderr, "%s: not a trace_decoder CSV\n", argv[1]);
+		fclose(file);
+		return 2;
+	}
+
+	unsigned readings = 0;
+	unsigned lastMs = 0;
+	for (unsigned number = 2; fgets(line, sizeof(line), file); ++number)
+	{
+		unsigned seconds, millis, echo, mm;
+		char state[16];
+		if (!expect(sscanf(line, "%u.%u,%u,%u,%15s", &seconds, &millis, &echo, &mm, state) == 5,
+			"not a reading with a distance", number, 0, 0))
+		{
+			continue;
+		}
+		unsigned ms = seconds * 1000 + millis;
+		expect(!readings || ms > lastMs, "reading out of time order, at ms", number, ms, lastMs);
+		unsigned expectedMm = hostDistanceMm(traceWaypoints, NELEMS(traceWaypoints), ms);
+		expect(mm + TOLERANCE_MM >= expectedMm && mm <= expectedMm + TOLERANCE_MM, "distance in mm", number, mm,
+			expectedMm);
+		expect(strcmp(state, "ACTIVE") == 0, "reading not in ACTIVE, at ms", number, ms, 0);
+		lastMs = ms;
+		++readings;
+	}
+	fclose(file);
+
+	expect(readings >= MIN_READINGS, "too few readings", readings + 1, readings, MIN_READINGS);
+	uint32_t pressMs = tracePresses[0].ms;
+	expect(lastMs + BUTTON_POLL_MS >= pressMs && lastMs <= pressMs + BUTTON_POLL_MS, "trace ends at ms", readings + 1,
+		lastMs, pressMs);
+
+	printf("trace_check: %u readings %s\n", readings, g_failed ? "FAILED" : "passed");
+	return g_failed ? 1 : 0;
+}
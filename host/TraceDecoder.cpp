@@ -0,0 +1,110 @@
+/*
+* TraceDecoder.cpp
+*
+* Created: 10/16/2026 11:20:37 PM
+*/
+
+// Turns a trace frozen to EEPROM by the firmware (see ParkingHelper/TraceRecorder.h) back into a CSV on stdout, one
+// reading per line. Reads a raw EEPROM image, e.g. from avrdude -U eeprom:r:eeprom.bin:r, and finds the trace by its
+// magic byte and CRC, so it doesn't need to know where the linker put it.
+//
+//     trace_decoder eeprom.bin > trace.csv
+//
+// Times are scheduler time in seconds, which stands still while the firmware is dormant. Readings that timed out or
+// went beyond the active range have no distance.
+
+#include "Scheduler.h"
+#include "DistanceSensor.h"
+#include "TraceRecorder.h"
+#include "Crc8.h"
+#include <stddef.h>
+#include <stdio.h>
+
+const size_t MAX_EEPROM_SIZE = 4096;
+const uint8_t CRC_OFFSET = offsetof(TraceBlock, crc);
+
+// The ParkingHelper states, in the order of its State enum
+static const char* const stateNames[] = { "IDLE", "ACTIVE", "PROGRAM", "?" };
+
+static bool isTrace(const uint8_t* block)
+{
+	return block[offsetof(TraceBlock, magic)] == TraceRecorder::TRACE_MAGIC
+		&& block[offsetof(TraceBlock, length)] <= TraceRecorder::TRACE_BYTES
+		&& crc8(block, CRC_OFFSET) == block[CRC_OFFSET];
+}
+
+// Reads the varint at data[*index], and moves past it. Returns false if it runs off the end.
+static bool takeVarint(const uint8_t* data, uint8_t length, uint8_t* index, uint32_t* value)
+{
+	*value = 0;
+	for (uint8_t shift = 0; *index < length && shift < 32; shift += 7)
+	{
+		uint8_t b = data[(*index)++];
+		*value |= (uint32_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static void decode(const uint8_t* block)
+{
+	const uint8_t* data = block + offsetof(TraceBlock, data);
+	uint8_t length = block[offsetof(TraceBlock, length)];
+	const uint8_t* p = block + offsetof(TraceBlock, echo);
+	uint16_t echo = p[0] | (p[1] << 8);
+	p = block + offsetof(TraceBlock, time);
+	uint32_t time = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+
+	printf("time_s,echo_ticks,distance_mm,state\n");
+	uint8_t index = 0;
+	uint32_t delta;
+	uint32_t echoState;
+	while (takeVarint(data, length, &index, &delta) && takeVarint(data, length, &index, &echoState))
+	{
+		time += delta;
+		uint16_t zigzag = echoState >> 2;
+		echo += (zigzag >> 1) ^ -(zigzag & 1);
+		printf("%.3f,%u,", (double)time * SCHEDULER_TIMER_PRESCALER / F_CPU, echo);
+		if (echo != 0 && echo != DistanceSensor::BEYOND_RANGE)
+		{
+			printf("%u", ECHO_TICKS_TO_MM(echo));
+		}
+		printf(",%s\n", stateNames[echoState & 0x03]);
+	}
+	if (index != length)
+	{
+		fprintf(stderr, "trace ends part way through a sample\n");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s eeprom.bin\n", argv[0]);
+		return 2;
+	}
+	FILE* file = fopen(argv[1], "rb");
+	if (!file)
+	{
+		perror(argv[1]);
+		return 2;
+	}
+	static uint8_t eeprom[MAX_EEPROM_SIZE];
+	size_t size = fread(eeprom, 1, sizeof(eeprom), file);
+	fclose(file);
+
+	for (size_t offset = 0; offset + CRC_OFFSET < size; ++offset)
+	{
+		if (isTrace(eeprom + offset))
+		{
+			decode(eeprom + offset);
+			return 0;
+		}
+	}
+	fprintf(stderr, "%s: no trace found\n", argv[1]);
+	return 1;
+}
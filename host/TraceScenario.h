@@ -0,0 +1,24 @@
+/*
+* TraceScenario.h
+*
+* Created: 10/17/2026 4:42:10 PM
+*/
+
+
+#ifndef __TRACESCENARIO_H__
+#define __TRACESCENARIO_H__
+
+// The script of the trace scenario, shared by host/Scenarios.cpp, which runs it, and host/TraceCheck.cpp, which checks
+// the trace it leaves in EEPROM against it. A vehicle closes slowly on the sensor, so the readings in the trace change
+// from one to the next, and the button is pressed while it is still moving, to start the program countdown, then
+// again before the countdown ends, to freeze the trace.
+
+#include "HostSimulator.h"
+
+const Waypoint traceWaypoints[] = {
+	{ 0, 4000 }, { 2000, 3000 }, { 22000, 500 }, { 45000, 500 }
+};
+const ButtonPress tracePresses[] = { { 20000, 500 }, { 25000, 300 } };
+const uint32_t TRACE_END_MS = 45000;
+
+#endif //__TRACESCENARIO_H__
@@ -0,0 +1,24 @@
+# Runs the trace scenario (host/TraceScenario.h) in the instrumented simulator, decodes the trace it leaves in the
+# EEPROM image with trace_decoder, and checks the CSV against the scenario with trace_check. Run by ctest, with SIM,
+# DECODER, CHECKER and WORK_DIR defined.
+
+set(EEPROM_IMAGE ${WORK_DIR}/trace_eeprom.bin)
+set(TRACE_CSV ${WORK_DIR}/trace.csv)
+file(REMOVE ${EEPROM_IMAGE} ${TRACE_CSV})
+
+execute_process(
+	COMMAND ${CMAKE_COMMAND} -E env PARKING_HELPER_SCENARIO=trace PARKING_HELPER_EEPROM=${EEPROM_IMAGE} ${SIM}
+	RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "trace scenario failed")
+endif()
+
+execute_process(COMMAND ${DECODER} ${EEPROM_IMAGE} OUTPUT_FILE ${TRACE_CSV} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "trace_decoder failed on ${EEPROM_IMAGE}")
+endif()
+
+execute_process(COMMAND ${CHECKER} ${TRACE_CSV} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "trace_check failed on ${TRACE_CSV}")
+endif()